@@ -0,0 +1,182 @@
+/**
+ * @file aesd-arena.c
+ * @brief Page backed entry storage for the aesd char driver
+ *
+ * Entries are placed one after another in a ring of data pages and are never
+ * split, so a whole entry can be read straight from the user space mapping.
+ * Locking, and waiting for readers of retired space, is left to the caller.
+ */
+
+#include "aesd-arena.h"
+#include "aesd-compat.h"
+
+/**
+ * Allocates the header page and @param data_pages data pages of @param arena
+ * @return 0 on success, a negative error code otherwise.
+ */
+int
+aesd_arena_init(struct aesd_arena *arena, size_t data_pages)
+{
+  BUILD_BUG_ON(sizeof(struct aesd_mmap_header) > PAGE_SIZE);
+
+  memset(arena, 0, sizeof(struct aesd_arena));
+
+  if (!data_pages)
+    return -EINVAL;
+
+  arena->base = vmalloc_user(PAGE_SIZE + data_pages * PAGE_SIZE);
+  if (!arena->base)
+    return -ENOMEM;
+
+  arena->header = arena->base;
+  arena->data = (char *)arena->base + PAGE_SIZE;
+  arena->data_size = data_pages * PAGE_SIZE;
+  arena->header->data_offset = PAGE_SIZE;
+  arena->header->data_size = arena->data_size;
+
+  return 0;
+}
+
+void
+aesd_arena_cleanup(struct aesd_arena *arena)
+{
+  vfree(arena->base);
+  memset(arena, 0, sizeof(struct aesd_arena));
+}
+
+/**
+ * @return the number of bytes that can be mapped from @param arena
+ */
+size_t
+aesd_arena_map_size(const struct aesd_arena *arena)
+{
+  return PAGE_SIZE + arena->data_size;
+}
+
+/**
+ * @return the offset where an entry of @param size bytes would be placed,
+ * wrapping to the start of the data area when it doesn't fit before the end.
+ * @param size must not exceed arena->data_size.
+ */
+size_t
+aesd_arena_place(const struct aesd_arena *arena, size_t size)
+{
+  return arena->head + size <= arena->data_size ? arena->head : 0;
+}
+
+/**
+ * @return true if the data of @param entry intersects the range of
+ * @param size bytes starting at @param offset.
+ */
+bool
+aesd_arena_overlaps_entry(
+  const struct aesd_arena *arena,
+  size_t offset,
+  size_t size,
+  const struct aesd_buffer_entry *entry)
+{
+  size_t entry_offset;
+
+  if (!entry->buffptr)
+    return false;
+
+  entry_offset = entry->buffptr - arena->data;
+
+  return offset < entry_offset + entry->size && entry_offset < offset + size;
+}
+
+/**
+ * @return true if the range of @param size bytes starting at @param offset
+ * intersects space retired since the last call to aesd_arena_settle.
+ */
+bool
+aesd_arena_overlaps_retired(
+  const struct aesd_arena *arena,
+  size_t offset,
+  size_t size)
+{
+  size_t distance;
+
+  if (!arena->retired_size)
+    return false;
+
+  distance =
+    (offset + arena->data_size - arena->retired_offset) % arena->data_size;
+
+  return distance < arena->retired_size || distance + size > arena->data_size;
+}
+
+/**
+ * Records that the entry at @param buffptr was evicted. Entries must be
+ * retired in the order they were claimed, so the retired space stays a single
+ * range which also covers the unused gaps between them.
+ */
+void
+aesd_arena_retire(struct aesd_arena *arena, const char *buffptr, size_t size)
+{
+  size_t end = buffptr - arena->data + size;
+  size_t retired_size;
+
+  if (!arena->retired_size) {
+    arena->retired_offset = buffptr - arena->data;
+    arena->retired_size = size;
+  } else {
+    retired_size =
+      (end + arena->data_size - arena->retired_offset) % arena->data_size;
+    if (retired_size < arena->retired_size || !retired_size)
+      retired_size = arena->data_size;
+    arena->retired_size = retired_size;
+  }
+
+  arena->retired_pending = true;
+}
+
+/**
+ * Forgets every retired range, once no reader can be using it anymore.
+ */
+void
+aesd_arena_settle(struct aesd_arena *arena)
+{
+  arena->retired_size = 0;
+  arena->retired_pending = false;
+}
+
+/**
+ * Takes the @param size bytes at @param offset, as returned by
+ * aesd_arena_place, and advances the head past them.
+ * @return the location where the entry contents must be stored.
+ */
+char *
+aesd_arena_claim(struct aesd_arena *arena, size_t offset, size_t size)
+{
+  arena->head = offset + size;
+
+  return arena->data + offset;
+}
+
+/**
+ * Describes the entries of @param buffer, which must all be stored in
+ * @param arena, in the header shared with user space.
+ */
+void
+aesd_arena_publish(
+  struct aesd_arena *arena,
+  const struct aesd_circular_buffer *buffer)
+{
+  struct aesd_mmap_header *header = arena->header;
+  const struct aesd_buffer_entry *entryptr;
+  uint32_t count = 0;
+
+  WRITE_ONCE(header->generation, header->generation + 1);
+  smp_wmb();
+
+  while ((entryptr = aesd_entry_ring_at(&buffer->entries, count))) {
+    header->entry[count].offset = entryptr->buffptr - arena->data;
+    header->entry[count].size = entryptr->size;
+    ++count;
+  }
+  header->entry_count = count;
+
+  smp_wmb();
+  WRITE_ONCE(header->generation, header->generation + 1);
+}
@@ -0,0 +1,75 @@
+/*
+ * aesd-arena.h
+ *
+ * Page backed storage for the aesd char driver entries, laid out as described
+ * in aesd_mmap.h so it can be mapped to user space.
+ */
+
+#ifndef AESD_ARENA_H
+#define AESD_ARENA_H
+
+#include "aesd-circular-buffer.h"
+#include "aesd_mmap.h"
+
+struct aesd_arena
+{
+  /**
+   * Header page followed by the data pages, allocated with vmalloc_user
+   */
+  void *base;
+  struct aesd_mmap_header *header;
+  char *data;
+  size_t data_size;
+  /**
+   * Offset in data where the next entry should be placed
+   */
+  size_t head;
+  /**
+   * Ring range of data holding evicted entries which readers that started
+   * before the eviction may still be copying from.
+   */
+  size_t retired_offset;
+  size_t retired_size;
+  /**
+   * Set while some retired range has no grace period started for it yet
+   */
+  bool retired_pending;
+  unsigned long retired_cookie;
+};
+
+extern int aesd_arena_init(struct aesd_arena *arena, size_t data_pages);
+
+extern void aesd_arena_cleanup(struct aesd_arena *arena);
+
+extern size_t aesd_arena_map_size(const struct aesd_arena *arena);
+
+extern size_t aesd_arena_place(const struct aesd_arena *arena, size_t size);
+
+extern bool aesd_arena_overlaps_entry(
+  const struct aesd_arena *arena,
+  size_t offset,
+  size_t size,
+  const struct aesd_buffer_entry *entry);
+
+extern bool aesd_arena_overlaps_retired(
+  const struct aesd_arena *arena,
+  size_t offset,
+  size_t size);
+
+extern void aesd_arena_retire(
+  struct aesd_arena *arena,
+  const char *buffptr,
+  size_t size);
+
+extern void aesd_arena_settle(struct aesd_arena *arena);
+
+extern char *aesd_arena_claim(
+  struct aesd_arena *arena,
+  size_t offset,
+  size_t size);
+
+extern void aesd_arena_publish(
+  struct aesd_arena *arena,
+  const struct aesd_circular_buffer *buffer);
+
+#endif /* AESD_ARENA_H */
@@ -20,123 +20,6 @@
 
 #include "aesd-circular-buffer.h"
 
-static inline uint8_t aesd_circular_buffer_entry_array_capacity(
-  const struct aesd_circular_buffer *buffer);
-static inline uint8_t aesd_circular_buffer_relative_entry_offset(
-  const struct aesd_circular_buffer *buffer,
-  uint8_t entry_offset);
-static inline uint8_t aesd_circular_buffer_absolute_entry_offset(
-  const struct aesd_circular_buffer *buffer,
-  uint8_t entry_offset);
-static inline uint8_t aesd_circular_buffer_entry_array_size(
-  const struct aesd_circular_buffer *buffer);
-static inline uint8_t aesd_circular_buffer_next_entry_offset(
-  const struct aesd_circular_buffer *buffer,
-  uint8_t entry_offset);
-static inline ssize_t aesd_circular_buffer_substract_entry_from_fpos(
-  struct aesd_buffer_entry *entryptr,
-  size_t char_offset);
-static struct aesd_buffer_entry *
-aesd_circular_buffer_iterate_find_entry_offset_for_fpos(
-  struct aesd_circular_buffer *buffer,
-  uint8_t *entry_offset,
-  size_t *char_offset);
-
-uint8_t
-aesd_circular_buffer_entry_array_capacity(
-  const struct aesd_circular_buffer *buffer)
-{
-  return sizeof(buffer->entry) / sizeof(struct aesd_buffer_entry);
-}
-
-uint8_t
-aesd_circular_buffer_relative_entry_offset(
-  const struct aesd_circular_buffer *buffer,
-  uint8_t entry_offset)
-{
-  uint8_t result;
-  uint8_t adjusted_entry_offset =
-    entry_offset % aesd_circular_buffer_entry_array_capacity(buffer);
-
-  if (buffer->full && adjusted_entry_offset == buffer->in_offs)
-    result = aesd_circular_buffer_entry_array_capacity(buffer);
-  else if (adjusted_entry_offset >= buffer->out_offs)
-    result = adjusted_entry_offset - buffer->out_offs;
-  else
-    result = adjusted_entry_offset +
-             aesd_circular_buffer_entry_array_capacity(buffer) -
-             buffer->out_offs;
-
-  return result;
-}
-
-uint8_t
-aesd_circular_buffer_absolute_entry_offset(
-  const struct aesd_circular_buffer *buffer,
-  uint8_t entry_offset)
-{
-  return (buffer->out_offs + entry_offset) %
-         aesd_circular_buffer_entry_array_capacity(buffer);
-}
-
-uint8_t
-aesd_circular_buffer_entry_array_size(const struct aesd_circular_buffer *buffer)
-{
-  uint8_t result;
-
-  if (buffer->full)
-    result = aesd_circular_buffer_entry_array_capacity(buffer);
-  else
-    result = (buffer->in_offs - buffer->out_offs) %
-             aesd_circular_buffer_entry_array_capacity(buffer);
-
-  return result;
-}
-
-uint8_t
-aesd_circular_buffer_next_entry_offset(
-  const struct aesd_circular_buffer *buffer,
-  uint8_t entry_offset)
-{
-  return (entry_offset + 1) % aesd_circular_buffer_entry_array_capacity(buffer);
-}
-
-ssize_t
-aesd_circular_buffer_substract_entry_from_fpos(
-  struct aesd_buffer_entry *entryptr,
-  size_t char_offset)
-{
-  ssize_t result = -1;
-
-  if (char_offset >= entryptr->size)
-    result = char_offset - entryptr->size;
-
-  return result;
-}
-
-struct aesd_buffer_entry *
-aesd_circular_buffer_iterate_find_entry_offset_for_fpos(
-  struct aesd_circular_buffer *buffer,
-  uint8_t *entry_offset,
-  size_t *char_offset)
-{
-  struct aesd_buffer_entry *result = NULL;
-  ssize_t substraction = 0;
-
-  substraction = aesd_circular_buffer_substract_entry_from_fpos(
-    buffer->entry + *entry_offset,
-    *char_offset);
-  if (substraction < 0) {
-    result = buffer->entry + *entry_offset;
-  } else {
-    *char_offset = substraction;
-    *entry_offset =
-      aesd_circular_buffer_next_entry_offset(buffer, *entry_offset);
-  }
-
-  return result;
-}
-
 /**
  * @param buffer the buffer to search for corresponding offset.  Any necessary
  * locking must be performed by caller.
@@ -157,24 +40,17 @@ aesd_circular_buffer_find_entry_offset_for_fpos(
   size_t char_offset,
   size_t *entry_offset_byte_rtn)
 {
-  size_t remaining = char_offset;
-  uint8_t entry_offset = buffer->out_offs;
   struct aesd_buffer_entry *result = NULL;
-
-  if (0 < aesd_circular_buffer_entry_array_size(buffer)) {
-    result = aesd_circular_buffer_iterate_find_entry_offset_for_fpos(
-      buffer,
-      &entry_offset,
-      &remaining);
-  }
-
-  while (!result &&
-         aesd_circular_buffer_relative_entry_offset(buffer, entry_offset) <
-           aesd_circular_buffer_entry_array_size(buffer)) {
-    result = aesd_circular_buffer_iterate_find_entry_offset_for_fpos(
-      buffer,
-      &entry_offset,
-      &remaining);
+  struct aesd_buffer_entry *entryptr;
+  size_t remaining = char_offset;
+  size_t i;
+
+  for (i = 0; !result && (entryptr = aesd_entry_ring_at(&buffer->entries, i));
+       ++i) {
+    if (remaining < entryptr->size)
+      result = entryptr;
+    else
+      remaining -= entryptr->size;
   }
 
   if (result)
@@ -198,63 +74,82 @@ aesd_circular_buffer_find_fpos_for_entry_offset(
   uint8_t entry_offset,
   size_t entry_offset_byte)
 {
-  uint8_t iter;
+  struct aesd_buffer_entry *entryptr =
+    aesd_entry_ring_at(&buffer->entries, entry_offset);
   ssize_t result = -1;
+  uint8_t i;
 
-  if (
-    entry_offset < aesd_circular_buffer_entry_array_size(buffer) &&
-    entry_offset_byte < buffer
-                          ->entry[aesd_circular_buffer_absolute_entry_offset(
-                            buffer,
-                            entry_offset)]
-                          .size) {
-    iter = buffer->out_offs;
-    result = 0;
-
-    if (0 < entry_offset) {
-      result += buffer->entry[iter].size;
-      iter = aesd_circular_buffer_next_entry_offset(buffer, iter);
-    }
-
-    while (aesd_circular_buffer_relative_entry_offset(buffer, iter) <
-           entry_offset) {
-      result += buffer->entry[iter].size;
-      iter = aesd_circular_buffer_next_entry_offset(buffer, iter);
-    }
-
-    result += entry_offset_byte;
+  if (entryptr && entry_offset_byte < entryptr->size) {
+    result = entry_offset_byte;
+    for (i = 0; i < entry_offset; ++i)
+      result += aesd_entry_ring_at(&buffer->entries, i)->size;
   }
 
   return result;
 }
 
 /**
- * Adds entry @param add_entry to @param buffer in the location specified in
- * buffer->in_offs. If the buffer was already full, overwrites the oldest
- * entry and advances buffer->out_offs to the new start location. Any
- * necessary locking must be handled by the caller Any memory referenced in
- * @param add_entry must be allocated by and/or must have a lifetime managed
- * by the caller.
+ * Adds entry @param add_entry to @param buffer as its newest entry. If the
+ * buffer was already full, overwrites the oldest entry and returns its
+ * buffptr so the caller can release it. Any necessary locking must be handled
+ * by the caller. Any memory referenced in @param add_entry must be allocated
+ * by and/or must have a lifetime managed by the caller.
  */
 const char *
 aesd_circular_buffer_add_entry(
   struct aesd_circular_buffer *buffer,
   const struct aesd_buffer_entry *add_entry)
 {
-  const char *old = NULL;
-  if (buffer->full)
-    old = buffer->entry[buffer->in_offs].buffptr;
+  struct aesd_buffer_entry evicted;
 
-  buffer->entry[buffer->in_offs] = *add_entry;
-  buffer->in_offs =
-    aesd_circular_buffer_next_entry_offset(buffer, buffer->in_offs);
+  if (aesd_entry_ring_push_overwrite(&buffer->entries, add_entry, &evicted))
+    return evicted.buffptr;
 
-  if (buffer->full)
-    buffer->out_offs = buffer->in_offs;
-  else if (buffer->in_offs == buffer->out_offs)
-    buffer->full = true;
+  return NULL;
+}
 
-  return old;
+/**
+ * Removes the oldest entry of @param buffer and clears its slot. Any necessary
+ * locking must be handled by the caller.
+ * @param size_rtn is a pointer specifying a location to store the size of the
+ * removed entry. This value is only set when an entry is removed.
+ * @return the buffptr of the removed entry, or NULL if the buffer was empty.
+ */
+const char *
+aesd_circular_buffer_remove_entry(
+  struct aesd_circular_buffer *buffer,
+  size_t *size_rtn)
+{
+  struct aesd_buffer_entry *oldest = aesd_entry_ring_at(&buffer->entries, 0);
+  struct aesd_buffer_entry removed = { NULL, 0 };
+
+  if (aesd_entry_ring_pop(&buffer->entries, &removed)) {
+    memset(oldest, 0, sizeof(struct aesd_buffer_entry));
+    *size_rtn = removed.size;
+  }
+
+  return removed.buffptr;
+}
+
+/**
+ * @return the entry at zero referenced position @param entry_offset counting
+ * from the oldest one, or NULL if fewer entries are stored.
+ */
+struct aesd_buffer_entry *
+aesd_circular_buffer_entry(
+  struct aesd_circular_buffer *buffer,
+  uint8_t entry_offset)
+{
+  return aesd_entry_ring_at(&buffer->entries, entry_offset);
+}
+
+/**
+ * @return the number of entries currently stored
+ */
+uint8_t
+aesd_circular_buffer_count(const struct aesd_circular_buffer *buffer)
+{
+  return aesd_entry_ring_count(&buffer->entries);
 }
 
 /**
@@ -284,5 +179,5 @@ aesd_circular_buffer_size(const struct aesd_circular_buffer *buffer)
 void
 aesd_circular_buffer_init(struct aesd_circular_buffer *buffer)
 {
-  memset(buffer, 0, sizeof(struct aesd_circular_buffer));
+  aesd_entry_ring_init(&buffer->entries);
 }
@@ -17,7 +17,12 @@
 #include <sys/types.h>
 #endif
 
+#include "aesd-ring.h"
+
+/* Overridable for benchmarks, at most 255 as entries are indexed by uint8_t */
+#ifndef AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
+#endif
 
 struct aesd_buffer_entry
 {
@@ -31,26 +36,17 @@ struct aesd_buffer_entry
   size_t size;
 };
 
+/**
+ * Ring of the entries of the most recent write operations, oldest first
+ */
+AESD_RING_DEFINE(
+  aesd_entry_ring,
+  struct aesd_buffer_entry,
+  AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED)
+
 struct aesd_circular_buffer
 {
-  /**
-   * An array of pointers to memory allocated for the most recent write
-   * operations
-   */
-  struct aesd_buffer_entry entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
-  /**
-   * The current location in the entry structure where the next write should
-   * be stored.
-   */
-  uint8_t in_offs;
-  /**
-   * The first location in the entry structure to read from
-   */
-  uint8_t out_offs;
-  /**
-   * Set to true when the buffer entry structure is full
-   */
-  bool full;
+  struct aesd_entry_ring entries;
 };
 
 extern struct aesd_buffer_entry *
@@ -68,6 +64,17 @@ extern const char *aesd_circular_buffer_add_entry(
   struct aesd_circular_buffer *buffer,
   const struct aesd_buffer_entry *add_entry);
 
+extern const char *aesd_circular_buffer_remove_entry(
+  struct aesd_circular_buffer *buffer,
+  size_t *size_rtn);
+
+extern struct aesd_buffer_entry *aesd_circular_buffer_entry(
+  struct aesd_circular_buffer *buffer,
+  uint8_t entry_offset);
+
+extern uint8_t aesd_circular_buffer_count(
+  const struct aesd_circular_buffer *buffer);
+
 extern size_t aesd_circular_buffer_size(
   const struct aesd_circular_buffer *buffer);
 
@@ -87,8 +94,8 @@ extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
  * }
  */
 #define AESD_CIRCULAR_BUFFER_FOREACH(entryptr, buffer, index)                  \
-  for (index = 0, entryptr = &((buffer)->entry[index]);                        \
+  for (index = 0, entryptr = &((buffer)->entries.slot[index]);                 \
        index < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;                        \
-       index++, entryptr = &((buffer)->entry[index]))
+       index++, entryptr = &((buffer)->entries.slot[index]))
 
 #endif /* AESD_CIRCULAR_BUFFER_H */
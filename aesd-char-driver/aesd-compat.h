@@ -0,0 +1,397 @@
+/*
+ * aesd-compat.h
+ *
+ * Kernel facilities used by the aesd char driver core. In a kernel build this
+ * only pulls in the kernel headers; otherwise it provides user space stand-ins
+ * so aesd-device.c can be built as a library for benchmarking and fuzzing:
+ *   - mutexes and wait queues map to pthread mutexes and condition variables,
+ *   - SRCU maps to a writer preferring rwlock, so call_srcu waits for the
+ *     readers of the old version and then runs the callback immediately,
+ *   - user copies are plain memcpy and an iov_iter is an array of iovecs,
+ *   - the tracepoints of aesd-trace.h compile to nothing.
+ */
+
+#ifndef AESD_COMPAT_H
+#define AESD_COMPAT_H
+
+#ifdef __KERNEL__
+
+#include <asm/uaccess.h>
+#include <linux/cdev.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/srcu.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#include "aesd-trace.h"
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef ERESTARTSYS
+#define ERESTARTSYS EINTR
+#endif
+
+#define __user
+#define __rcu
+
+typedef uint64_t u64;
+typedef off_t loff_t;
+
+#define PAGE_SIZE 4096UL
+
+#define container_of(ptr, type, member)                                        \
+  ((type *)((char *)(ptr)-offsetof(type, member)))
+
+#define min_t(type, x, y) ((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#define max_t(type, x, y) ((type)(x) > (type)(y) ? (type)(x) : (type)(y))
+
+#define BUILD_BUG_ON(condition) _Static_assert(!(condition), #condition)
+
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, val) __atomic_store_n(&(x), (val), __ATOMIC_RELAXED)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+
+#define EPOLLIN POLLIN
+#define EPOLLRDNORM POLLRDNORM
+
+#define GFP_KERNEL 0
+
+static inline void *
+kmalloc(size_t size, int flags)
+{
+  (void)flags;
+  return malloc(size);
+}
+
+static inline void *
+kzalloc(size_t size, int flags)
+{
+  (void)flags;
+  return calloc(1, size);
+}
+
+static inline void *
+kcalloc(size_t n, size_t size, int flags)
+{
+  (void)flags;
+  return calloc(n, size);
+}
+
+static inline void *
+krealloc(const void *ptr, size_t size, int flags)
+{
+  (void)flags;
+  return realloc((void *)ptr, size);
+}
+
+static inline void
+kfree(const void *ptr)
+{
+  free((void *)ptr);
+}
+
+static inline void *
+vmalloc_user(unsigned long size)
+{
+  void *result = aligned_alloc(PAGE_SIZE, size);
+
+  if (result)
+    memset(result, 0, size);
+
+  return result;
+}
+
+static inline void
+vfree(const void *ptr)
+{
+  free((void *)ptr);
+}
+
+static inline unsigned long
+copy_to_user(void *to, const void *from, unsigned long n)
+{
+  memcpy(to, from, n);
+  return 0;
+}
+
+static inline unsigned long
+copy_from_user(void *to, const void *from, unsigned long n)
+{
+  memcpy(to, from, n);
+  return 0;
+}
+
+struct mutex
+{
+  pthread_mutex_t mutex;
+};
+
+#define mutex_init(lock) pthread_mutex_init(&(lock)->mutex, NULL)
+#define mutex_destroy(lock) pthread_mutex_destroy(&(lock)->mutex)
+#define mutex_lock_interruptible(lock) pthread_mutex_lock(&(lock)->mutex)
+#define mutex_unlock(lock) pthread_mutex_unlock(&(lock)->mutex)
+#define lockdep_is_held(lock) true
+
+struct rcu_head
+{
+  struct rcu_head *next;
+};
+
+struct srcu_struct
+{
+  pthread_rwlock_t lock;
+};
+
+static inline int
+init_srcu_struct(struct srcu_struct *ssp)
+{
+  pthread_rwlockattr_t attr;
+  int result;
+
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(
+    &attr,
+    PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  result = -pthread_rwlock_init(&ssp->lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  return result;
+}
+
+static inline void
+cleanup_srcu_struct(struct srcu_struct *ssp)
+{
+  pthread_rwlock_destroy(&ssp->lock);
+}
+
+static inline int
+srcu_read_lock(struct srcu_struct *ssp)
+{
+  pthread_rwlock_rdlock(&ssp->lock);
+  return 0;
+}
+
+static inline void
+srcu_read_unlock(struct srcu_struct *ssp, int idx)
+{
+  (void)idx;
+  pthread_rwlock_unlock(&ssp->lock);
+}
+
+static inline void
+synchronize_srcu(struct srcu_struct *ssp)
+{
+  pthread_rwlock_wrlock(&ssp->lock);
+  pthread_rwlock_unlock(&ssp->lock);
+}
+
+static inline void
+call_srcu(
+  struct srcu_struct *ssp,
+  struct rcu_head *head,
+  void (*func)(struct rcu_head *head))
+{
+  synchronize_srcu(ssp);
+  func(head);
+}
+
+static inline void
+srcu_barrier(struct srcu_struct *ssp)
+{
+  (void)ssp;
+}
+
+/* Every call_srcu has already waited for its readers. */
+static inline unsigned long
+start_poll_synchronize_srcu(struct srcu_struct *ssp)
+{
+  (void)ssp;
+  return 0;
+}
+
+static inline bool
+poll_state_synchronize_srcu(struct srcu_struct *ssp, unsigned long cookie)
+{
+  (void)ssp;
+  (void)cookie;
+  return true;
+}
+
+#define srcu_dereference(p, ssp) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} wait_queue_head_t;
+
+#define init_waitqueue_head(wq)                                                \
+  do {                                                                         \
+    pthread_mutex_init(&(wq)->lock, NULL);                                     \
+    pthread_cond_init(&(wq)->cond, NULL);                                      \
+  } while (0)
+
+#define wake_up_interruptible_poll(wq, mask)                                   \
+  do {                                                                         \
+    pthread_mutex_lock(&(wq)->lock);                                           \
+    pthread_cond_broadcast(&(wq)->cond);                                       \
+    pthread_mutex_unlock(&(wq)->lock);                                         \
+  } while (0)
+
+#define wait_event_interruptible(wq, condition)                                \
+  ({                                                                           \
+    pthread_mutex_lock(&(wq).lock);                                            \
+    while (!(condition))                                                       \
+      pthread_cond_wait(&(wq).cond, &(wq).lock);                               \
+    pthread_mutex_unlock(&(wq).lock);                                          \
+    0;                                                                         \
+  })
+
+struct file
+{
+  void *private_data;
+  loff_t f_pos;
+  unsigned int f_flags;
+};
+
+struct kiocb
+{
+  struct file *ki_filp;
+  loff_t ki_pos;
+};
+
+struct iov_iter
+{
+  const struct iovec *iov;
+  unsigned long nr_segs;
+  size_t iov_offset;
+  size_t count;
+};
+
+static inline void
+aesd_iov_iter_init(
+  struct iov_iter *iter,
+  const struct iovec *iov,
+  unsigned long nr_segs)
+{
+  iter->iov = iov;
+  iter->nr_segs = nr_segs;
+  iter->iov_offset = 0;
+  iter->count = 0;
+
+  for (unsigned long i = 0; i < nr_segs; ++i)
+    iter->count += iov[i].iov_len;
+}
+
+static inline size_t
+iov_iter_count(const struct iov_iter *iter)
+{
+  return iter->count;
+}
+
+static inline size_t
+copy_from_iter(void *to, size_t bytes, struct iov_iter *iter)
+{
+  size_t copied = 0;
+  size_t chunk;
+
+  while (copied < bytes && iter->nr_segs) {
+    chunk = min_t(
+      size_t,
+      bytes - copied,
+      iter->iov->iov_len - iter->iov_offset);
+    memcpy(
+      (char *)to + copied,
+      (const char *)iter->iov->iov_base + iter->iov_offset,
+      chunk);
+    copied += chunk;
+    iter->iov_offset += chunk;
+
+    if (iter->iov_offset == iter->iov->iov_len) {
+      ++iter->iov;
+      --iter->nr_segs;
+      iter->iov_offset = 0;
+    }
+  }
+  iter->count -= copied;
+
+  return copied;
+}
+
+static inline loff_t
+fixed_size_llseek(struct file *filp, loff_t offset, int whence, loff_t size)
+{
+  loff_t result;
+
+  switch (whence) {
+    case SEEK_SET:
+      result = offset;
+      break;
+    case SEEK_CUR:
+      result = filp->f_pos + offset;
+      break;
+    case SEEK_END:
+      result = size + offset;
+      break;
+    default:
+      return -EINVAL;
+  }
+
+  if (result < 0 || result > size)
+    return -EINVAL;
+
+  filp->f_pos = result;
+
+  return result;
+}
+
+#define trace_aesdchar_read_start(filp, pos, count)                            \
+  do {                                                                         \
+  } while (0)
+#define trace_aesdchar_read_end(filp, pos, retval)                             \
+  do {                                                                         \
+  } while (0)
+#define trace_aesdchar_write_start(filp, pos, count)                           \
+  do {                                                                         \
+  } while (0)
+#define trace_aesdchar_write_end(filp, pos, retval)                            \
+  do {                                                                         \
+  } while (0)
+#define trace_aesdchar_seekto_start(filp, write_cmd, write_cmd_offset)         \
+  do {                                                                         \
+  } while (0)
+#define trace_aesdchar_seekto_end(filp, pos, retval)                           \
+  do {                                                                         \
+  } while (0)
+
+#endif /* __KERNEL__ */
+
+#endif /* AESD_COMPAT_H */
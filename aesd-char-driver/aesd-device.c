@@ -0,0 +1,688 @@
+/**
+ * @file aesd-device.c
+ * @brief Read, write and seek logic of the AESD char driver
+ *
+ * Everything here is independent from the file_operations and module glue in
+ * main.c, and builds in user space on top of the stand-ins of aesd-compat.h.
+ */
+
+#include "aesd-arena.h"
+#include "aesd-circular-buffer.h"
+#include "aesd-compat.h"
+#include "aesd_ioctl.h"
+#include "aesdchar.h"
+
+#define TERMINATOR_CHARACTER '\n'
+#define MSG_MAX_LEN 100
+
+static ssize_t aesd_find_char(const char *buffer, size_t count, char character);
+static struct aesd_buffer_version *aesd_version_new(
+  const struct aesd_buffer_version *current_version);
+static void aesd_version_reclaim(struct rcu_head *head);
+static void aesd_version_publish(
+  struct aesd_dev *dev,
+  struct aesd_buffer_version *old_version,
+  struct aesd_buffer_version *new_version);
+static size_t aesd_make_room(
+  struct aesd_dev *dev,
+  struct aesd_buffer_version *version,
+  size_t offset,
+  size_t size);
+static size_t aesd_fitting_size(
+  const char *buffptr,
+  size_t size,
+  size_t limit);
+static ssize_t aesd_commit_entries(
+  struct aesd_dev *dev,
+  const char *buffptr,
+  size_t size);
+static bool aesd_version_readable(
+  const struct aesd_buffer_version *version,
+  const struct aesd_file *file,
+  loff_t f_pos);
+static loff_t aesd_version_follow_fpos(
+  struct aesd_buffer_version *version,
+  const struct aesd_file *file,
+  loff_t f_pos);
+
+ssize_t
+aesd_find_char(const char *buffer, size_t count, char character)
+{
+  const char *found = memchr(buffer, character, count);
+
+  return found ? found - buffer : -1;
+}
+
+struct aesd_buffer_version *
+aesd_version_new(const struct aesd_buffer_version *current_version)
+{
+  struct aesd_buffer_version *result = NULL;
+
+  result = kmalloc(sizeof(struct aesd_buffer_version), GFP_KERNEL);
+  if (result) {
+    result->buffer = current_version->buffer;
+    result->generation = current_version->generation;
+  }
+
+  return result;
+}
+
+void
+aesd_version_reclaim(struct rcu_head *head)
+{
+  struct aesd_buffer_version *version =
+    container_of(head, struct aesd_buffer_version, rcu);
+
+  kfree(version);
+}
+
+/*
+ * Must be called with dev->lock held. The old version, and whatever it marks
+ * as retired, is freed once every reader that could still see it is done.
+ */
+void
+aesd_version_publish(
+  struct aesd_dev *dev,
+  struct aesd_buffer_version *old_version,
+  struct aesd_buffer_version *new_version)
+{
+  rcu_assign_pointer(dev->version, new_version);
+  call_srcu(&dev->srcu, &old_version->rcu, aesd_version_reclaim);
+}
+
+/*
+ * Must be called with dev->lock held. Evicts from @param version the oldest
+ * entries until it has a free slot and none of its entries overlaps the
+ * @param size bytes at @param offset of the arena.
+ * @return the number of evicted entries.
+ */
+size_t
+aesd_make_room(
+  struct aesd_dev *dev,
+  struct aesd_buffer_version *version,
+  size_t offset,
+  size_t size)
+{
+  size_t evicted = 0;
+  size_t evicted_size;
+  const char *evicted_buffptr;
+  struct aesd_buffer_entry *entryptr = NULL;
+  uint8_t index = 0;
+  bool overlaps = aesd_circular_buffer_count(&version->buffer) ==
+                  AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+
+  AESD_CIRCULAR_BUFFER_FOREACH(entryptr, &version->buffer, index)
+  {
+    overlaps = overlaps ||
+               aesd_arena_overlaps_entry(&dev->arena, offset, size, entryptr);
+  }
+
+  while (overlaps) {
+    evicted_buffptr =
+      aesd_circular_buffer_remove_entry(&version->buffer, &evicted_size);
+    aesd_arena_retire(&dev->arena, evicted_buffptr, evicted_size);
+    ++evicted;
+
+    overlaps = false;
+    AESD_CIRCULAR_BUFFER_FOREACH(entryptr, &version->buffer, index)
+    {
+      overlaps = overlaps || aesd_arena_overlaps_entry(
+                               &dev->arena,
+                               offset,
+                               size,
+                               entryptr);
+    }
+  }
+
+  return evicted;
+}
+
+/*
+ * @return the size of the records of @param buffptr before the first one,
+ * counting a trailing unterminated one, larger than @param limit, which is
+ * @param size if there is none.
+ */
+size_t
+aesd_fitting_size(const char *buffptr, size_t size, size_t limit)
+{
+  size_t consumed = 0;
+  ssize_t terminator_position;
+
+  while (consumed < size) {
+    terminator_position =
+      aesd_find_char(buffptr + consumed, size - consumed, TERMINATOR_CHARACTER);
+    if (terminator_position < 0)
+      terminator_position = size - consumed - 1;
+
+    if (terminator_position + 1 > limit)
+      break;
+    consumed += terminator_position + 1;
+  }
+
+  return consumed;
+}
+
+/*
+ * Copies every complete record of @param buffptr into the arena and appends
+ * them to the shared ring, taking the lock and publishing a version once for
+ * the whole batch. The caller keeps ownership of @param buffptr.
+ * @return the number of bytes committed, which always end with a terminator,
+ * or a negative error code if none could be.
+ */
+ssize_t
+aesd_commit_entries(struct aesd_dev *dev, const char *buffptr, size_t size)
+{
+  ssize_t retval = -ENOMEM;
+  ssize_t terminator_position;
+  size_t committed = 0;
+  size_t offset;
+  struct aesd_buffer_version *old_version;
+  struct aesd_buffer_version *new_version = NULL;
+  struct aesd_buffer_entry entry;
+
+  terminator_position = aesd_find_char(buffptr, size, TERMINATOR_CHARACTER);
+  if (terminator_position < 0)
+    return 0;
+
+  if (mutex_lock_interruptible(&dev->lock))
+    return -ERESTARTSYS;
+
+  old_version =
+    rcu_dereference_protected(dev->version, lockdep_is_held(&dev->lock));
+
+  TRY(
+    new_version = aesd_version_new(old_version),
+    "buffer version allocation failed");
+
+  while (terminator_position >= 0) {
+    entry.size = terminator_position + 1;
+    offset = aesd_arena_place(&dev->arena, entry.size);
+    aesd_make_room(dev, new_version, offset, entry.size);
+
+    /*
+     * Readers of an older version may still be copying from retired space.
+     * The grace period started when it was retired has usually elapsed by
+     * the time the head wraps around to it; otherwise wait for it, after
+     * unpublishing whatever was just evicted.
+     */
+    if (
+      aesd_arena_overlaps_retired(&dev->arena, offset, entry.size) &&
+      (dev->arena.retired_pending ||
+       !poll_state_synchronize_srcu(&dev->srcu, dev->arena.retired_cookie))) {
+      if (dev->arena.retired_pending) {
+        aesd_version_publish(dev, old_version, new_version);
+        aesd_arena_publish(&dev->arena, &new_version->buffer);
+        wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
+        old_version = new_version;
+        new_version = NULL;
+      }
+
+      synchronize_srcu(&dev->srcu);
+      aesd_arena_settle(&dev->arena);
+
+      if (!new_version) {
+        TRY(
+          new_version = aesd_version_new(old_version),
+          "buffer version allocation failed");
+      }
+    }
+
+    entry.buffptr = aesd_arena_claim(&dev->arena, offset, entry.size);
+    memcpy((char *)entry.buffptr, buffptr + committed, entry.size);
+    aesd_circular_buffer_add_entry(&new_version->buffer, &entry);
+    ++new_version->generation;
+    committed += entry.size;
+
+    terminator_position = aesd_find_char(
+      buffptr + committed,
+      size - committed,
+      TERMINATOR_CHARACTER);
+  }
+
+  aesd_version_publish(dev, old_version, new_version);
+  aesd_arena_publish(&dev->arena, &new_version->buffer);
+  wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
+  new_version = NULL;
+
+  if (dev->arena.retired_pending) {
+    dev->arena.retired_cookie = start_poll_synchronize_srcu(&dev->srcu);
+    dev->arena.retired_pending = false;
+  }
+
+  retval = committed;
+
+done:
+  /* Records published before a failure stay committed. */
+  if (retval < 0 && committed)
+    retval = committed;
+
+  kfree(new_version);
+  mutex_unlock(&dev->lock);
+
+  return retval;
+}
+
+/*
+ * True if a read at @param f_pos would return data from @param version,
+ * either because it lies before the end or because @param file follows and
+ * entries were committed since it last reached the end.
+ */
+bool
+aesd_version_readable(
+  const struct aesd_buffer_version *version,
+  const struct aesd_file *file,
+  loff_t f_pos)
+{
+  return f_pos < aesd_circular_buffer_size(&version->buffer) ||
+         (file->follow && version->generation != READ_ONCE(file->generation));
+}
+
+bool
+aesd_readable(struct aesd_dev *dev, const struct aesd_file *file, loff_t f_pos)
+{
+  bool result;
+  int srcu_index;
+
+  srcu_index = srcu_read_lock(&dev->srcu);
+  result = aesd_version_readable(
+    srcu_dereference(dev->version, &dev->srcu),
+    file,
+    f_pos);
+  srcu_read_unlock(&dev->srcu, srcu_index);
+
+  return result;
+}
+
+/*
+ * Offsets shift as old entries are evicted, so a following reader which
+ * reached the end may be left past it. Moves such a reader to the first entry
+ * committed since it got there, or to the oldest entry if some of those were
+ * evicted already.
+ */
+loff_t
+aesd_version_follow_fpos(
+  struct aesd_buffer_version *version,
+  const struct aesd_file *file,
+  loff_t f_pos)
+{
+  u64 committed = version->generation - READ_ONCE(file->generation);
+  uint8_t count = aesd_circular_buffer_count(&version->buffer);
+
+  if (f_pos < aesd_circular_buffer_size(&version->buffer) || !committed)
+    return f_pos;
+
+  if (committed >= count)
+    return 0;
+
+  return aesd_circular_buffer_find_fpos_for_entry_offset(
+    &version->buffer,
+    count - committed,
+    0);
+}
+
+long
+aesd_iocseekto(struct file *filp, uint32_t write_cmd, uint32_t write_cmd_offset)
+{
+  long result = -EINVAL;
+  struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
+  struct aesd_buffer_version *version;
+  ssize_t f_pos;
+  int srcu_index;
+
+  PDEBUG(
+    "seeking write command %u with offset %u",
+    write_cmd,
+    write_cmd_offset);
+  trace_aesdchar_seekto_start(filp, write_cmd, write_cmd_offset);
+
+  srcu_index = srcu_read_lock(&dev->srcu);
+  version = srcu_dereference(dev->version, &dev->srcu);
+
+  f_pos = aesd_circular_buffer_find_fpos_for_entry_offset(
+    &version->buffer,
+    write_cmd,
+    write_cmd_offset);
+
+  if (f_pos >= 0) {
+    result = fixed_size_llseek(
+      filp,
+      f_pos,
+      SEEK_SET,
+      aesd_circular_buffer_size(&version->buffer));
+  }
+
+  srcu_read_unlock(&dev->srcu, srcu_index);
+  trace_aesdchar_seekto_end(filp, filp->f_pos, result);
+
+  return result;
+}
+
+long
+aesd_iocgetindex(struct file *filp, struct aesd_index __user *index)
+{
+  struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
+  struct aesd_buffer_version *version;
+  struct aesd_buffer_entry *entryptr;
+  struct aesd_index local_index;
+  uint64_t offset = 0;
+  uint32_t i;
+  int srcu_index;
+
+  PDEBUG("getting entry index");
+
+  memset(&local_index, 0, sizeof(struct aesd_index));
+
+  srcu_index = srcu_read_lock(&dev->srcu);
+  version = srcu_dereference(dev->version, &dev->srcu);
+
+  local_index.generation = version->generation;
+  local_index.entry_count = aesd_circular_buffer_count(&version->buffer);
+
+  for (i = 0; i < local_index.entry_count; ++i) {
+    entryptr = aesd_circular_buffer_entry(&version->buffer, i);
+    local_index.entry[i].write_cmd = i;
+    local_index.entry[i].offset = offset;
+    local_index.entry[i].size = entryptr->size;
+    offset += entryptr->size;
+  }
+
+  srcu_read_unlock(&dev->srcu, srcu_index);
+
+  if (copy_to_user(index, &local_index, sizeof(struct aesd_index)))
+    return -EFAULT;
+
+  return 0;
+}
+
+void
+aesd_file_init(struct aesd_file *file, struct aesd_dev *dev)
+{
+  int srcu_index;
+
+  memset(file, 0, sizeof(struct aesd_file));
+
+  file->dev = dev;
+  mutex_init(&file->lock);
+  srcu_index = srcu_read_lock(&dev->srcu);
+  file->generation = srcu_dereference(dev->version, &dev->srcu)->generation;
+  srcu_read_unlock(&dev->srcu, srcu_index);
+}
+
+void
+aesd_file_cleanup(struct aesd_file *file)
+{
+  /* A record never terminated by this file is dropped. */
+  kfree(file->unterminated_buffptr);
+  file->unterminated_buffptr = NULL;
+  file->unterminated_size = 0;
+  mutex_destroy(&file->lock);
+}
+
+ssize_t
+aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
+{
+  ssize_t retval = -1;
+  ssize_t error = 0;
+  struct aesd_file *file = filp->private_data;
+  struct aesd_dev *dev = file->dev;
+  struct aesd_buffer_version *version;
+  struct aesd_buffer_entry *current_entry = NULL;
+  size_t current_entry_byte;
+  size_t final_count = 0;
+  int srcu_index;
+
+  PDEBUG("read %zu bytes with offset %lld", count, *f_pos);
+  trace_aesdchar_read_start(filp, *f_pos, count);
+
+  /*
+   * SRCU rather than plain RCU: copy_to_user may fault and sleep while the
+   * version is still being referenced.
+   */
+  srcu_index = srcu_read_lock(&dev->srcu);
+  version = srcu_dereference(dev->version, &dev->srcu);
+
+  while (file->follow && !aesd_version_readable(version, file, *f_pos)) {
+    srcu_read_unlock(&dev->srcu, srcu_index);
+
+    if (filp->f_flags & O_NONBLOCK) {
+      trace_aesdchar_read_end(filp, *f_pos, -EAGAIN);
+      return -EAGAIN;
+    }
+
+    if (wait_event_interruptible(
+          dev->wait,
+          aesd_readable(dev, file, *f_pos))) {
+      trace_aesdchar_read_end(filp, *f_pos, -ERESTARTSYS);
+      return -ERESTARTSYS;
+    }
+
+    srcu_index = srcu_read_lock(&dev->srcu);
+    version = srcu_dereference(dev->version, &dev->srcu);
+  }
+
+  if (file->follow)
+    *f_pos = aesd_version_follow_fpos(version, file, *f_pos);
+
+  current_entry = aesd_circular_buffer_find_entry_offset_for_fpos(
+    &version->buffer,
+    *f_pos,
+    &current_entry_byte);
+
+  if (current_entry) {
+    final_count = current_entry->size - current_entry_byte;
+    final_count = count < final_count ? count : final_count;
+
+    PDEBUG(
+      "writing %.*s",
+      (int)min_t(size_t, final_count, MSG_MAX_LEN),
+      current_entry->buffptr + current_entry_byte);
+
+    TRYZ(
+      error = copy_to_user(
+        buf,
+        current_entry->buffptr + current_entry_byte,
+        final_count),
+      "error while writing in the user buffer");
+  }
+
+  *f_pos += final_count;
+  retval = final_count;
+
+  if (*f_pos >= aesd_circular_buffer_size(&version->buffer))
+    WRITE_ONCE(file->generation, version->generation);
+
+done:
+  if (retval < 0 && error != 0)
+    retval = -EFAULT;
+
+  srcu_read_unlock(&dev->srcu, srcu_index);
+  trace_aesdchar_read_end(filp, *f_pos, retval);
+
+  return retval;
+}
+
+ssize_t
+aesd_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+  ssize_t retval = -ENOMEM;
+  ssize_t committed = 0;
+  size_t count = iov_iter_count(from);
+  size_t total_size;
+  size_t fitting_size;
+  char *buffptr = NULL;
+  struct aesd_file *file = iocb->ki_filp->private_data;
+
+  PDEBUG("write %zu bytes with offset %lld", count, iocb->ki_pos);
+
+  if (!count)
+    return 0;
+
+  trace_aesdchar_write_start(iocb->ki_filp, iocb->ki_pos, count);
+
+  if (mutex_lock_interruptible(&file->lock)) {
+    trace_aesdchar_write_end(iocb->ki_filp, iocb->ki_pos, -ERESTARTSYS);
+    return -ERESTARTSYS;
+  }
+
+  total_size = file->unterminated_size + count;
+
+  TRY(
+    buffptr = (char *)krealloc(
+      file->unterminated_buffptr,
+      total_size * sizeof(char),
+      GFP_KERNEL),
+    "buffer pointer allocation failed");
+  file->unterminated_buffptr = buffptr;
+
+  if (
+    copy_from_iter(buffptr + file->unterminated_size, count, from) != count) {
+    PRINT_ERROR("error while copying from user");
+    retval = -EFAULT;
+    goto done;
+  }
+
+  PDEBUG(
+    "writing %.*s",
+    (int)min_t(size_t, count, MSG_MAX_LEN),
+    buffptr + file->unterminated_size);
+
+  /*
+   * A record which can never fit in the arena is refused with the records
+   * after it, as a short write of those before it. Retrying the rest then
+   * fails with -EFBIG, which drops the record whole.
+   */
+  fitting_size =
+    aesd_fitting_size(buffptr, total_size, file->dev->arena.data_size);
+  if (!fitting_size) {
+    kfree(file->unterminated_buffptr);
+    file->unterminated_buffptr = NULL;
+    file->unterminated_size = 0;
+    retval = -EFBIG;
+    goto done;
+  }
+
+  TRYC(
+    committed = aesd_commit_entries(file->dev, buffptr, fitting_size),
+    "entry commit failed");
+
+  if (fitting_size < total_size) {
+    /* The unterminated bytes were part of the first committed record */
+    count = committed - file->unterminated_size;
+    file->unterminated_size = 0;
+  } else {
+    file->unterminated_size = total_size - committed;
+  }
+
+  if (!file->unterminated_size) {
+    kfree(file->unterminated_buffptr);
+    file->unterminated_buffptr = NULL;
+  } else if (committed) {
+    memmove(buffptr, buffptr + committed, file->unterminated_size);
+  }
+
+  iocb->ki_pos += count;
+  retval = count;
+
+done:
+
+  if (retval < 0) {
+    if (committed < 0)
+      retval = committed;
+
+    if (file->unterminated_buffptr && file->unterminated_size == 0) {
+      kfree(file->unterminated_buffptr);
+      file->unterminated_buffptr = NULL;
+    }
+  }
+
+  mutex_unlock(&file->lock);
+  trace_aesdchar_write_end(iocb->ki_filp, iocb->ki_pos, retval);
+
+  return retval;
+}
+
+loff_t
+aesd_llseek(struct file *filp, loff_t offset, int whence)
+{
+  struct aesd_file *file = filp->private_data;
+  struct aesd_dev *dev = file->dev;
+  struct aesd_buffer_version *version;
+  loff_t retval = 0;
+  int srcu_index;
+
+  PDEBUG("ENTERING LLSEEK");
+  PDEBUG("seeking offset %llu with whence %d\n", offset, whence);
+
+  srcu_index = srcu_read_lock(&dev->srcu);
+  version = srcu_dereference(dev->version, &dev->srcu);
+
+  retval = fixed_size_llseek(
+    filp,
+    offset,
+    whence,
+    aesd_circular_buffer_size(&version->buffer));
+
+  /* Seeking to the end counts as reaching it, so only later entries follow */
+  if (retval >= (loff_t)aesd_circular_buffer_size(&version->buffer))
+    WRITE_ONCE(file->generation, version->generation);
+
+  srcu_read_unlock(&dev->srcu, srcu_index);
+  PDEBUG("new file offset: %llu\n", retval);
+  PDEBUG("EXITING LLSEEK");
+
+  return retval;
+}
+
+int
+aesd_dev_init(struct aesd_dev *dev, size_t arena_pages)
+{
+  int result;
+  int ok = -1;
+  bool srcu_initialized = false;
+  struct aesd_buffer_version *version = NULL;
+
+  memset(dev, 0, sizeof(struct aesd_dev));
+
+  mutex_init(&dev->lock);
+  init_waitqueue_head(&dev->wait);
+  TRYC(result = init_srcu_struct(&dev->srcu), "srcu initialization failed");
+  srcu_initialized = true;
+
+  result = -ENOMEM;
+  TRY(
+    version = kzalloc(sizeof(struct aesd_buffer_version), GFP_KERNEL),
+    "buffer version allocation failed");
+  aesd_circular_buffer_init(&version->buffer);
+  RCU_INIT_POINTER(dev->version, version);
+
+  TRYC(
+    result = aesd_arena_init(&dev->arena, arena_pages),
+    "entry storage allocation failed");
+
+  ok = result;
+
+done:
+  if (ok < 0) {
+    kfree(version);
+    aesd_arena_cleanup(&dev->arena);
+
+    if (srcu_initialized)
+      cleanup_srcu_struct(&dev->srcu);
+
+    if (result < 0) {
+      ok = result;
+    }
+  }
+
+  return ok;
+}
+
+void
+aesd_dev_cleanup(struct aesd_dev *dev)
+{
+  /* Wait for every retired version to be reclaimed. */
+  srcu_barrier(&dev->srcu);
+  kfree(rcu_dereference_protected(dev->version, true));
+  aesd_arena_cleanup(&dev->arena);
+  cleanup_srcu_struct(&dev->srcu);
+}
@@ -0,0 +1,457 @@
+/*
+ * aesd-ring.h
+ *
+ * Header only ring buffers, specialised for an element type and a capacity by
+ * the generator macros below. Shared by the aesd char driver and the server.
+ *
+ * AESD_RING_DEFINE(name, type, capacity)
+ *   Single threaded ring of at most capacity elements. Any capacity works, a
+ *   power of two one turns every index computation into a mask.
+ *
+ * AESD_RING_DEFINE_SPSC(name, type, capacity)
+ * AESD_RING_DEFINE_MPSC(name, type, capacity)
+ * AESD_RING_DEFINE_MPMC(name, type, capacity)
+ *   Lock free rings for one or several producers and consumers. The
+ *   capacity must be a power of two.
+ *
+ * AESD_RING_DEFINE_GROWABLE(name, type, initial_capacity)
+ *   User space only, single threaded ring that doubles its power of two
+ *   capacity instead of failing a push.
+ *
+ * Each macro defines struct name and static inline functions name_<op>, e.g.
+ *
+ *   AESD_RING_DEFINE(int_ring, int, 16)
+ *
+ *   struct int_ring ring;
+ *   int value = 1;
+ *
+ *   int_ring_init(&ring);
+ *   int_ring_push(&ring, &value);
+ *   int_ring_pop(&ring, &value);
+ */
+
+#ifndef AESD_RING_H
+#define AESD_RING_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#endif
+
+#define AESD_RING_CACHELINE_SIZE 64
+
+#define AESD_RING_IS_POW2(n) ((n) != 0 && ((n) & ((n)-1)) == 0)
+
+/*
+ * The positions of AESD_RING_DEFINE run over [0, 2 * capacity), so that a full
+ * ring (in - out == capacity) is told apart from an empty one without wasting
+ * a slot or keeping a flag.
+ */
+#define AESD_RING_DEFINE(name, type, capacity)                                 \
+  _Static_assert((capacity) > 0, #name " capacity must be positive");          \
+                                                                               \
+  struct name                                                                  \
+  {                                                                            \
+    type slot[capacity];                                                       \
+    size_t in;                                                                 \
+    size_t out;                                                                \
+  };                                                                           \
+                                                                               \
+  static inline size_t name##_capacity(void)                                   \
+  {                                                                            \
+    return (capacity);                                                         \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_advance(size_t position, size_t count)           \
+  {                                                                            \
+    if (AESD_RING_IS_POW2(capacity))                                           \
+      return (position + count) & (2 * (capacity)-1);                          \
+                                                                               \
+    position += count;                                                         \
+    return position >= 2 * (capacity) ? position - 2 * (capacity) : position;  \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_slot_index(size_t position)                      \
+  {                                                                            \
+    if (AESD_RING_IS_POW2(capacity))                                           \
+      return position & ((capacity)-1);                                        \
+                                                                               \
+    return position >= (capacity) ? position - (capacity) : position;          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_init(struct name *ring)                            \
+  {                                                                            \
+    memset(ring, 0, sizeof(struct name));                                      \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_count(const struct name *ring)                   \
+  {                                                                            \
+    if (AESD_RING_IS_POW2(capacity))                                           \
+      return (ring->in - ring->out) & (2 * (capacity)-1);                      \
+                                                                               \
+    return ring->in >= ring->out ? ring->in - ring->out                        \
+                                 : ring->in + 2 * (capacity)-ring->out;        \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_is_empty(const struct name *ring)                  \
+  {                                                                            \
+    return ring->in == ring->out;                                              \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_is_full(const struct name *ring)                   \
+  {                                                                            \
+    return name##_count(ring) == (capacity);                                   \
+  }                                                                            \
+                                                                               \
+  /* Element @param index counting from the oldest one, NULL past the end */   \
+  static inline type *name##_at(const struct name *ring, size_t index)         \
+  {                                                                            \
+    if (index >= name##_count(ring))                                           \
+      return NULL;                                                             \
+                                                                               \
+    return (type *)&ring                                                       \
+      ->slot[name##_slot_index(name##_advance(ring->out, index))];             \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_push(struct name *ring, const type *value)         \
+  {                                                                            \
+    if (name##_is_full(ring))                                                  \
+      return false;                                                            \
+                                                                               \
+    ring->slot[name##_slot_index(ring->in)] = *value;                          \
+    ring->in = name##_advance(ring->in, 1);                                    \
+                                                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  /* Evicts the oldest element into @param evicted when full */                \
+  static inline bool name##_push_overwrite(                                    \
+    struct name *ring,                                                         \
+    const type *value,                                                         \
+    type *evicted)                                                             \
+  {                                                                            \
+    bool full = name##_is_full(ring);                                          \
+                                                                               \
+    if (full) {                                                                \
+      *evicted = ring->slot[name##_slot_index(ring->out)];                     \
+      ring->out = name##_advance(ring->out, 1);                                \
+    }                                                                          \
+                                                                               \
+    ring->slot[name##_slot_index(ring->in)] = *value;                          \
+    ring->in = name##_advance(ring->in, 1);                                    \
+                                                                               \
+    return full;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_pop(struct name *ring, type *value)                \
+  {                                                                            \
+    if (name##_is_empty(ring))                                                 \
+      return false;                                                            \
+                                                                               \
+    *value = ring->slot[name##_slot_index(ring->out)];                         \
+    ring->out = name##_advance(ring->out, 1);                                  \
+                                                                               \
+    return true;                                                               \
+  }
+
+/*
+ * Lamport's ring: each position is only ever written by one side, so the
+ * free running counters only need acquire/release ordering. Each side caches
+ * the counter of the other one to avoid touching its cache line on every call.
+ */
+#define AESD_RING_DEFINE_SPSC(name, type, capacity)                            \
+  _Static_assert(                                                              \
+    AESD_RING_IS_POW2(capacity),                                               \
+    #name " capacity must be a power of two");                                 \
+                                                                               \
+  struct name                                                                  \
+  {                                                                            \
+    type slot[capacity];                                                       \
+    size_t in __attribute__((aligned(AESD_RING_CACHELINE_SIZE)));              \
+    size_t cached_out;                                                         \
+    size_t out __attribute__((aligned(AESD_RING_CACHELINE_SIZE)));             \
+    size_t cached_in;                                                          \
+  };                                                                           \
+                                                                               \
+  static inline void name##_init(struct name *ring)                            \
+  {                                                                            \
+    memset(ring, 0, sizeof(struct name));                                      \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_count(const struct name *ring)                   \
+  {                                                                            \
+    return __atomic_load_n(&ring->in, __ATOMIC_ACQUIRE) -                      \
+           __atomic_load_n(&ring->out, __ATOMIC_ACQUIRE);                      \
+  }                                                                            \
+                                                                               \
+  /* Producer side */                                                          \
+  static inline bool name##_push(struct name *ring, const type *value)         \
+  {                                                                            \
+    size_t in = ring->in;                                                      \
+                                                                               \
+    if (in - ring->cached_out == (capacity)) {                                 \
+      ring->cached_out = __atomic_load_n(&ring->out, __ATOMIC_ACQUIRE);        \
+      if (in - ring->cached_out == (capacity))                                 \
+        return false;                                                          \
+    }                                                                          \
+                                                                               \
+    ring->slot[in & ((capacity)-1)] = *value;                                  \
+    __atomic_store_n(&ring->in, in + 1, __ATOMIC_RELEASE);                     \
+                                                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  /* Consumer side */                                                          \
+  static inline bool name##_pop(struct name *ring, type *value)                \
+  {                                                                            \
+    size_t out = ring->out;                                                    \
+                                                                               \
+    if (out == ring->cached_in) {                                              \
+      ring->cached_in = __atomic_load_n(&ring->in, __ATOMIC_ACQUIRE);          \
+      if (out == ring->cached_in)                                              \
+        return false;                                                          \
+    }                                                                          \
+                                                                               \
+    *value = ring->slot[out & ((capacity)-1)];                                 \
+    __atomic_store_n(&ring->out, out + 1, __ATOMIC_RELEASE);                   \
+                                                                               \
+    return true;                                                               \
+  }
+
+/*
+ * Vyukov's bounded queue: producers claim a position with a compare and swap
+ * on in, and every slot carries a sequence number telling whether it is free
+ * for the lap of that position or holds its value. The consumer side is added
+ * by AESD_RING_DEFINE_MPSC or AESD_RING_DEFINE_MPMC.
+ */
+#define AESD_RING_DEFINE_SEQUENCED(name, type, capacity)                       \
+  _Static_assert(                                                              \
+    AESD_RING_IS_POW2(capacity),                                               \
+    #name " capacity must be a power of two");                                 \
+                                                                               \
+  struct name##_cell                                                           \
+  {                                                                            \
+    size_t sequence;                                                           \
+    type value;                                                                \
+  };                                                                           \
+                                                                               \
+  struct name                                                                  \
+  {                                                                            \
+    struct name##_cell cell[capacity];                                         \
+    size_t in __attribute__((aligned(AESD_RING_CACHELINE_SIZE)));              \
+    size_t out __attribute__((aligned(AESD_RING_CACHELINE_SIZE)));             \
+  };                                                                           \
+                                                                               \
+  static inline void name##_init(struct name *ring)                            \
+  {                                                                            \
+    size_t i;                                                                  \
+                                                                               \
+    memset(ring, 0, sizeof(struct name));                                      \
+    for (i = 0; i < (capacity); ++i)                                           \
+      ring->cell[i].sequence = i;                                              \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_count(const struct name *ring)                   \
+  {                                                                            \
+    return __atomic_load_n(&ring->in, __ATOMIC_ACQUIRE) -                      \
+           __atomic_load_n(&ring->out, __ATOMIC_ACQUIRE);                      \
+  }                                                                            \
+                                                                               \
+  /* Any number of producers */                                                \
+  static inline bool name##_push(struct name *ring, const type *value)         \
+  {                                                                            \
+    struct name##_cell *cell;                                                  \
+    size_t in = __atomic_load_n(&ring->in, __ATOMIC_RELAXED);                  \
+    size_t sequence;                                                           \
+                                                                               \
+    for (;;) {                                                                 \
+      cell = &ring->cell[in & ((capacity)-1)];                                 \
+      sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);           \
+                                                                               \
+      if (sequence == in) {                                                    \
+        if (__atomic_compare_exchange_n(                                       \
+              &ring->in,                                                       \
+              &in,                                                             \
+              in + 1,                                                          \
+              true,                                                            \
+              __ATOMIC_RELAXED,                                                \
+              __ATOMIC_RELAXED))                                               \
+          break;                                                               \
+      } else if ((ptrdiff_t)(sequence - in) < 0) {                             \
+        return false;                                                          \
+      } else {                                                                 \
+        in = __atomic_load_n(&ring->in, __ATOMIC_RELAXED);                     \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    cell->value = *value;                                                      \
+    __atomic_store_n(&cell->sequence, in + 1, __ATOMIC_RELEASE);               \
+                                                                               \
+    return true;                                                               \
+  }
+
+#define AESD_RING_DEFINE_MPSC(name, type, capacity)                            \
+  AESD_RING_DEFINE_SEQUENCED(name, type, capacity)                             \
+                                                                               \
+  /* Single consumer */                                                        \
+  static inline bool name##_pop(struct name *ring, type *value)                \
+  {                                                                            \
+    size_t out = ring->out;                                                    \
+    struct name##_cell *cell = &ring->cell[out & ((capacity)-1)];              \
+                                                                               \
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != out + 1)         \
+      return false;                                                            \
+                                                                               \
+    *value = cell->value;                                                      \
+    __atomic_store_n(&cell->sequence, out + (capacity), __ATOMIC_RELEASE);     \
+    __atomic_store_n(&ring->out, out + 1, __ATOMIC_RELEASE);                   \
+                                                                               \
+    return true;                                                               \
+  }
+
+/* Consumers claim a position with a compare and swap on out. */
+#define AESD_RING_DEFINE_MPMC(name, type, capacity)                            \
+  AESD_RING_DEFINE_SEQUENCED(name, type, capacity)                             \
+                                                                               \
+  /* Any number of consumers */                                                \
+  static inline bool name##_pop(struct name *ring, type *value)                \
+  {                                                                            \
+    struct name##_cell *cell;                                                  \
+    size_t out = __atomic_load_n(&ring->out, __ATOMIC_RELAXED);                \
+    size_t sequence;                                                           \
+                                                                               \
+    for (;;) {                                                                 \
+      cell = &ring->cell[out & ((capacity)-1)];                                \
+      sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);           \
+                                                                               \
+      if (sequence == out + 1) {                                               \
+        if (__atomic_compare_exchange_n(                                       \
+              &ring->out,                                                      \
+              &out,                                                            \
+              out + 1,                                                         \
+              true,                                                            \
+              __ATOMIC_RELAXED,                                                \
+              __ATOMIC_RELAXED))                                               \
+          break;                                                               \
+      } else if ((ptrdiff_t)(sequence - (out + 1)) < 0) {                      \
+        return false;                                                          \
+      } else {                                                                 \
+        out = __atomic_load_n(&ring->out, __ATOMIC_RELAXED);                   \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    *value = cell->value;                                                      \
+    __atomic_store_n(&cell->sequence, out + (capacity), __ATOMIC_RELEASE);     \
+                                                                               \
+    return true;                                                               \
+  }
+
+#ifndef __KERNEL__
+
+#include <stdlib.h>
+
+/*
+ * Single threaded ring on a heap array whose power of two capacity doubles
+ * when a push finds it full. name_finalize frees the array.
+ */
+#define AESD_RING_DEFINE_GROWABLE(name, type, initial_capacity)                \
+  _Static_assert(                                                              \
+    AESD_RING_IS_POW2(initial_capacity),                                       \
+    #name " initial capacity must be a power of two");                         \
+                                                                               \
+  struct name                                                                  \
+  {                                                                            \
+    type *slot;                                                                \
+    size_t capacity;                                                           \
+    size_t in;                                                                 \
+    size_t out;                                                                \
+  };                                                                           \
+                                                                               \
+  static inline void name##_init(struct name *ring)                            \
+  {                                                                            \
+    memset(ring, 0, sizeof(struct name));                                      \
+  }                                                                            \
+                                                                               \
+  static inline void name##_finalize(struct name *ring)                        \
+  {                                                                            \
+    free(ring->slot);                                                          \
+    memset(ring, 0, sizeof(struct name));                                      \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_count(const struct name *ring)                   \
+  {                                                                            \
+    return ring->in - ring->out;                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_is_empty(const struct name *ring)                  \
+  {                                                                            \
+    return ring->in == ring->out;                                              \
+  }                                                                            \
+                                                                               \
+  static inline type *name##_at(const struct name *ring, size_t index)         \
+  {                                                                            \
+    if (index >= name##_count(ring))                                           \
+      return NULL;                                                             \
+                                                                               \
+    return &ring->slot[(ring->out + index) & (ring->capacity - 1)];            \
+  }                                                                            \
+                                                                               \
+  /* Moves the elements, oldest first, to the start of a larger array */      \
+  static inline bool name##_grow(struct name *ring)                            \
+  {                                                                            \
+    size_t capacity =                                                          \
+      ring->capacity ? 2 * ring->capacity : (initial_capacity);                \
+    size_t count = name##_count(ring);                                         \
+    size_t first = ring->capacity ? ring->out & (ring->capacity - 1) : 0;      \
+    size_t first_count = ring->capacity - first < count                        \
+                           ? ring->capacity - first                            \
+                           : count;                                            \
+    type *slot = malloc(capacity * sizeof(type));                              \
+                                                                               \
+    if (!slot)                                                                 \
+      return false;                                                            \
+                                                                               \
+    if (count) {                                                               \
+      memcpy(slot, ring->slot + first, first_count * sizeof(type));            \
+      memcpy(                                                                  \
+        slot + first_count,                                                    \
+        ring->slot,                                                            \
+        (count - first_count) * sizeof(type));                                 \
+    }                                                                          \
+                                                                               \
+    free(ring->slot);                                                          \
+    ring->slot = slot;                                                         \
+    ring->capacity = capacity;                                                 \
+    ring->out = 0;                                                             \
+    ring->in = count;                                                          \
+                                                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_push(struct name *ring, const type *value)         \
+  {                                                                            \
+    if (name##_count(ring) == ring->capacity && !name##_grow(ring))            \
+      return false;                                                            \
+                                                                               \
+    ring->slot[ring->in++ & (ring->capacity - 1)] = *value;                    \
+                                                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_pop(struct name *ring, type *value)                \
+  {                                                                            \
+    if (name##_is_empty(ring))                                                 \
+      return false;                                                            \
+                                                                               \
+    *value = ring->slot[ring->out++ & (ring->capacity - 1)];                   \
+                                                                               \
+    return true;                                                               \
+  }
+
+#endif /* __KERNEL__ */
+
+#endif /* AESD_RING_H */
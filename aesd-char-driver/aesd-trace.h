@@ -0,0 +1,108 @@
+/*
+ * aesd-trace.h
+ *
+ * Tracepoints of the aesdchar read, write and seekto paths, under
+ * /sys/kernel/tracing/events/aesdchar. Every path has a start and an end
+ * event so that perf or bpftrace can build latency histograms, for instance:
+ *
+ *   bpftrace -e 'tracepoint:aesdchar:aesdchar_read_start { @s[tid] = nsecs }
+ *     tracepoint:aesdchar:aesdchar_read_end /@s[tid]/ {
+ *       @read_ns = hist(nsecs - @s[tid]); delete(@s[tid]) }'
+ *
+ * main.c creates them. In the user space build they compile to nothing, see
+ * aesd-compat.h.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aesdchar
+
+#if !defined(AESD_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AESD_TRACE_H
+
+#include <linux/fs.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(
+  aesdchar_io_start,
+  TP_PROTO(struct file *filp, loff_t pos, size_t count),
+  TP_ARGS(filp, pos, count),
+  TP_STRUCT__entry(
+    __field(unsigned int, minor) __field(loff_t, pos) __field(size_t, count)),
+  TP_fast_assign(__entry->minor = iminor(file_inode(filp));
+                 __entry->pos = pos;
+                 __entry->count = count;),
+  TP_printk(
+    "minor=%u pos=%lld count=%zu",
+    __entry->minor,
+    __entry->pos,
+    __entry->count));
+
+DECLARE_EVENT_CLASS(
+  aesdchar_io_end,
+  TP_PROTO(struct file *filp, loff_t pos, ssize_t retval),
+  TP_ARGS(filp, pos, retval),
+  TP_STRUCT__entry(
+    __field(unsigned int, minor) __field(loff_t, pos) __field(ssize_t, retval)),
+  TP_fast_assign(__entry->minor = iminor(file_inode(filp));
+                 __entry->pos = pos;
+                 __entry->retval = retval;),
+  TP_printk(
+    "minor=%u pos=%lld retval=%zd",
+    __entry->minor,
+    __entry->pos,
+    __entry->retval));
+
+DEFINE_EVENT(
+  aesdchar_io_start,
+  aesdchar_read_start,
+  TP_PROTO(struct file *filp, loff_t pos, size_t count),
+  TP_ARGS(filp, pos, count));
+
+DEFINE_EVENT(
+  aesdchar_io_end,
+  aesdchar_read_end,
+  TP_PROTO(struct file *filp, loff_t pos, ssize_t retval),
+  TP_ARGS(filp, pos, retval));
+
+DEFINE_EVENT(
+  aesdchar_io_start,
+  aesdchar_write_start,
+  TP_PROTO(struct file *filp, loff_t pos, size_t count),
+  TP_ARGS(filp, pos, count));
+
+/* retval is the byte count taken, pos where the unterminated record ends */
+DEFINE_EVENT(
+  aesdchar_io_end,
+  aesdchar_write_end,
+  TP_PROTO(struct file *filp, loff_t pos, ssize_t retval),
+  TP_ARGS(filp, pos, retval));
+
+TRACE_EVENT(
+  aesdchar_seekto_start,
+  TP_PROTO(struct file *filp, u32 write_cmd, u32 write_cmd_offset),
+  TP_ARGS(filp, write_cmd, write_cmd_offset),
+  TP_STRUCT__entry(__field(unsigned int, minor) __field(u32, write_cmd)
+                     __field(u32, write_cmd_offset)),
+  TP_fast_assign(__entry->minor = iminor(file_inode(filp));
+                 __entry->write_cmd = write_cmd;
+                 __entry->write_cmd_offset = write_cmd_offset;),
+  TP_printk(
+    "minor=%u write_cmd=%u write_cmd_offset=%u",
+    __entry->minor,
+    __entry->write_cmd,
+    __entry->write_cmd_offset));
+
+DEFINE_EVENT(
+  aesdchar_io_end,
+  aesdchar_seekto_end,
+  TP_PROTO(struct file *filp, loff_t pos, ssize_t retval),
+  TP_ARGS(filp, pos, retval));
+
+#endif /* AESD_TRACE_H */
+
+/* Outside of the guard, define_trace.h includes this file again */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE aesd-trace
+#include <trace/define_trace.h>
@@ -18,6 +18,8 @@
 #include <stdint.h>
 #endif
 
+#include "aesd-circular-buffer.h"
+
 /**
  * A structure to be passed by IOCTL from user space to kernel space, describing the type
  * of seek performed on the aesdchar driver
@@ -33,14 +35,56 @@ struct aesd_seekto {
     uint32_t write_cmd_offset;
 };
 
+/**
+ * Location of one live entry, as returned by AESDCHAR_IOCGETINDEX
+ */
+struct aesd_index_entry {
+    /**
+     * The zero referenced write command, as used by AESDCHAR_IOCSEEKTO
+     */
+    uint32_t write_cmd;
+    uint32_t reserved;
+    /**
+     * Position of the first byte of the entry in the concatenated contents
+     */
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * A snapshot of every live entry, filled by AESDCHAR_IOCGETINDEX
+ */
+struct aesd_index {
+    /**
+     * Number of entries ever committed to the device, identifies the snapshot
+     */
+    uint64_t generation;
+    /**
+     * Number of valid elements in entry, oldest first
+     */
+    uint32_t entry_count;
+    uint32_t reserved;
+    struct aesd_index_entry entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+};
+
 // Pick an arbitrary unused value from https://github.com/torvalds/linux/blob/master/Documentation/userspace-api/ioctl/ioctl-number.rst
 #define AESD_IOC_MAGIC 0x16
 
 // Define a write command from the user point of view, use command number 1
 #define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+/**
+ * Enable (non zero) or disable (zero) follow mode on an open file. In follow
+ * mode a read at the end of the data waits for the next entry instead of
+ * returning 0, or fails with EAGAIN if the file is non blocking.
+ */
+#define AESDCHAR_IOCFOLLOW _IOW(AESD_IOC_MAGIC, 2, uint32_t)
+/**
+ * Read the index of every live entry in a single call
+ */
+#define AESDCHAR_IOCGETINDEX _IOR(AESD_IOC_MAGIC, 3, struct aesd_index)
 /**
  * The maximum number of commands supported, used for bounds checking
  */
-#define AESDCHAR_IOC_MAXNR 1
+#define AESDCHAR_IOC_MAXNR 3
 
 #endif /* AESD_IOCTL_H */
@@ -0,0 +1,49 @@
+/*
+ * aesd_mmap.h
+ *
+ *  @brief Layout of the read-only mapping exposed by mmap on aesd char devices
+ */
+
+#ifndef AESD_MMAP_H
+#define AESD_MMAP_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#include "aesd-circular-buffer.h"
+
+/**
+ * Location of a live entry, relative to the start of the data area
+ */
+struct aesd_mmap_entry {
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * Placed at offset 0 of the mapping, the data area starts at data_offset.
+ *
+ * The generation is a seqlock-style counter: it is odd while the driver is
+ * updating the mapping and advances by two per update, which may commit any
+ * number of entries, so it does not count them. A consumer reads it, copies
+ * the entry table and then the data it needs, and retries when a second read
+ * of the generation does not match the first, since the data of evicted
+ * entries is reused for newer ones. Consumers which need to count entries use
+ * AESDCHAR_IOCGETINDEX, whose unrelated generation counts every entry ever
+ * committed.
+ */
+struct aesd_mmap_header {
+    uint32_t generation;
+    /**
+     * Number of valid elements in entry, oldest first
+     */
+    uint32_t entry_count;
+    uint64_t data_offset;
+    uint64_t data_size;
+    struct aesd_mmap_entry entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+};
+
+#endif /* AESD_MMAP_H */
@@ -8,11 +8,14 @@
 #ifndef AESD_CHAR_DRIVER_AESDCHAR_H_
 #define AESD_CHAR_DRIVER_AESDCHAR_H_
 
+#include "aesd-arena.h"
 #include "aesd-circular-buffer.h"
-#include <linux/cdev.h>
-#include <linux/mutex.h>
+#include "aesd-compat.h"
+#include "aesd_ioctl.h"
 
+#ifndef AESD_NDEBUG
 #define AESD_DEBUG 1 // Remove comment on this line to enable debug
+#endif
 
 #undef PDEBUG /* undef it, just in case */
 #ifdef AESD_DEBUG
@@ -57,13 +60,70 @@
 
 #define TRYZ(expr, message) TRYCATCH((expr), goto done, message)
 
+/*
+ * Immutable snapshot of the device contents. Writers never modify a published
+ * version: they build a new one and swap it in, so readers can traverse it
+ * inside an SRCU read-side section without taking the writer lock.
+ */
+struct aesd_buffer_version
+{
+  struct aesd_circular_buffer buffer;
+  u64 generation; /* Number of entries ever committed */
+  struct rcu_head rcu;
+};
+
 struct aesd_dev
 {
-  struct mutex lock;
+  struct mutex lock; /* Serialises writers only  */
+  struct srcu_struct srcu;
+  struct aesd_buffer_version __rcu *version;
+  struct aesd_arena arena; /* Entry storage, written under lock */
+  wait_queue_head_t wait;  /* Woken when an entry is committed */
+#ifdef __KERNEL__
+  struct cdev cdev; /* Char device structure      */
+#endif
+};
+
+/*
+ * Per open file state. Partial writes accumulate here until a terminator
+ * arrives, so producers using different open files never interleave records.
+ */
+struct aesd_file
+{
+  struct aesd_dev *dev;
+  struct mutex lock; /* Serialises writers sharing this open file */
   char *unterminated_buffptr;
   size_t unterminated_size;
-  struct aesd_circular_buffer buffer;
-  struct cdev cdev; /* Char device structure      */
+  bool follow;
+  /* Generation of the last version read up to its end */
+  u64 generation;
 };
 
+extern int aesd_dev_init(struct aesd_dev *dev, size_t arena_pages);
+extern void aesd_dev_cleanup(struct aesd_dev *dev);
+
+extern void aesd_file_init(struct aesd_file *file, struct aesd_dev *dev);
+extern void aesd_file_cleanup(struct aesd_file *file);
+
+extern bool aesd_readable(
+  struct aesd_dev *dev,
+  const struct aesd_file *file,
+  loff_t f_pos);
+
+extern ssize_t aesd_read(
+  struct file *filp,
+  char __user *buf,
+  size_t count,
+  loff_t *f_pos);
+extern ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from);
+extern loff_t aesd_llseek(struct file *filp, loff_t offset, int whence);
+
+extern long aesd_iocseekto(
+  struct file *filp,
+  uint32_t write_cmd,
+  uint32_t write_cmd_offset);
+extern long aesd_iocgetindex(
+  struct file *filp,
+  struct aesd_index __user *index);
+
 #endif /* AESD_CHAR_DRIVER_AESDCHAR_H_ */
@@ -11,6 +11,7 @@
  *
  */
 
+#include "aesd-arena.h"
 #include "aesd-circular-buffer.h"
 #include "aesd_ioctl.h"
 #include "aesdchar.h"
@@ -19,85 +20,59 @@
 #include <linux/cdev.h>
 #include <linux/fs.h> // file_operations
 #include <linux/init.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
 
-#define TERMINATOR_CHARACTER '\n'
-#define MSG_MAX_LEN 100
+/* The tracepoints of aesd-trace.h are defined here */
+#define CREATE_TRACE_POINTS
+#include "aesd-trace.h"
+
+#define ARENA_DEFAULT_PAGES 256
+#define DEFAULT_NR_DEVS 1
 
 int aesd_major = 0; // use dynamic major
 int aesd_minor = 0;
 
-MODULE_AUTHOR("Jesús María Gómez Moreno");
-MODULE_LICENSE("Dual BSD/GPL");
-
-struct aesd_dev aesd_device;
-
-static ssize_t aesd_find_char(const char *buffer, size_t count, char character);
-static long aesd_iocseekto(
-  struct file *filp,
-  uint32_t write_cmd,
-  uint32_t wirte_cmd_offset);
-
-ssize_t
-aesd_find_char(const char *buffer, size_t count, char character)
-{
-  ssize_t result = -1;
-  size_t i = 0;
-
-  while (i < count && buffer[i] != character)
-    ++i;
-
-  if (i < count)
-    result = i;
+static unsigned int aesd_nr_devs = DEFAULT_NR_DEVS;
+module_param(aesd_nr_devs, uint, S_IRUGO);
+MODULE_PARM_DESC(aesd_nr_devs, "Number of devices, each with its own buffer");
 
-  return result;
-}
-
-static long
-aesd_iocseekto(struct file *filp, uint32_t write_cmd, uint32_t write_cmd_offset)
-{
-  long result = -EINVAL;
-  struct aesd_dev *dev = filp->private_data;
-  ssize_t f_pos;
+static unsigned int aesd_arena_pages = ARENA_DEFAULT_PAGES;
+module_param(aesd_arena_pages, uint, S_IRUGO);
+MODULE_PARM_DESC(aesd_arena_pages, "Pages of entry storage per device");
 
-  PDEBUG(
-    "seeking write command %u with offset %u",
-    write_cmd,
-    write_cmd_offset);
-
-  if (mutex_lock_interruptible(&dev->lock))
-    return -ERESTARTSYS;
-
-  f_pos = aesd_circular_buffer_find_fpos_for_entry_offset(
-    &dev->buffer,
-    write_cmd,
-    write_cmd_offset);
-
-  if (f_pos >= 0) {
-    result = fixed_size_llseek(
-      filp,
-      f_pos,
-      SEEK_SET,
-      aesd_circular_buffer_size(&dev->buffer));
-  }
+MODULE_AUTHOR("Jesús María Gómez Moreno");
+MODULE_LICENSE("Dual BSD/GPL");
 
-  mutex_unlock(&dev->lock);
+struct aesd_dev *aesd_devices = NULL;
+static unsigned int aesd_devs_initialized = 0;
+static unsigned int aesd_devs_added = 0;
 
-  return result;
-}
+static int aesd_setup_cdev(struct aesd_dev *dev, unsigned int index);
+static void aesd_teardown(void);
 
 int
 aesd_open(struct inode *inode, struct file *filp)
 {
+  struct aesd_file *file = NULL;
+
   PDEBUG("open");
 
-  filp->private_data = container_of(inode->i_cdev, struct aesd_dev, cdev);
+  file = kmalloc(sizeof(struct aesd_file), GFP_KERNEL);
+  if (!file)
+    return -ENOMEM;
+
+  aesd_file_init(file, container_of(inode->i_cdev, struct aesd_dev, cdev));
+  filp->private_data = file;
 
   return 0;
 }
@@ -105,178 +80,57 @@ aesd_open(struct inode *inode, struct file *filp)
 int
 aesd_release(struct inode *inode, struct file *filp)
 {
-  PDEBUG("release");
-
-  return 0;
-}
+  struct aesd_file *file = filp->private_data;
 
-ssize_t
-aesd_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
-{
-  ssize_t retval = -1;
-  ssize_t error = 0;
-  ssize_t remaining = 0;
-  struct aesd_dev *dev = filp->private_data;
-  struct aesd_buffer_entry *current_entry = NULL;
-  struct aesd_buffer_entry tmp_entry;
-  size_t current_entry_byte;
-  size_t final_count = 0;
-  char msg_buffer[MSG_MAX_LEN] = {};
-
-  PDEBUG("read %zu bytes with offset %lld", count, *f_pos);
-
-  if (mutex_lock_interruptible(&dev->lock))
-    return -ERESTARTSYS;
-
-  current_entry = aesd_circular_buffer_find_entry_offset_for_fpos(
-    &dev->buffer,
-    *f_pos,
-    &current_entry_byte);
-
-  if (
-    !current_entry &&
-    ((remaining = *f_pos - aesd_circular_buffer_size(&dev->buffer)) <
-     dev->unterminated_size)) {
-    current_entry_byte = remaining;
-    tmp_entry.buffptr = dev->unterminated_buffptr;
-    tmp_entry.size = dev->unterminated_size;
-    current_entry = &tmp_entry;
-  }
-
-  if (current_entry) {
-    final_count = current_entry->size - current_entry_byte;
-    final_count = count < final_count ? count : final_count;
-
-    strncpy(
-      msg_buffer,
-      current_entry->buffptr + current_entry_byte,
-      final_count);
-    PDEBUG("writing %s", msg_buffer);
-
-    TRYZ(
-      error = copy_to_user(
-        buf,
-        current_entry->buffptr + current_entry_byte,
-        final_count),
-      "error while writing in the user buffer");
-  }
-
-  *f_pos += final_count;
-  retval = final_count;
-
-done:
-  if (retval < 0 && error != 0)
-    retval = -EFAULT;
+  PDEBUG("release");
 
-  mutex_unlock(&dev->lock);
+  aesd_file_cleanup(file);
+  kfree(file);
 
-  return retval;
+  return 0;
 }
 
-ssize_t
-aesd_write(
-  struct file *filp,
-  const char __user *buf,
-  size_t count,
-  loff_t *f_pos)
+__poll_t
+aesd_poll(struct file *filp, poll_table *wait)
 {
-  ssize_t retval = -ENOMEM;
-  ssize_t error = 0;
-  ssize_t terminator_position = 0;
-  size_t final_count = 0;
-  char *buffptr = NULL;
-  const char *oldptr = NULL;
-  struct aesd_dev *dev = filp->private_data;
-  struct aesd_buffer_entry entry;
-  char msg_buffer[MSG_MAX_LEN] = {};
-
-  PDEBUG("write %zu bytes with offset %lld", count, *f_pos);
-
-  if (mutex_lock_interruptible(&dev->lock))
-    return -ERESTARTSYS;
-
-  if (count) {
-    TRY(
-      dev->unterminated_buffptr = (char *)krealloc(
-        dev->unterminated_buffptr,
-        (dev->unterminated_size + count) * sizeof(char),
-        GFP_KERNEL),
-      "buffer pointer allocation failed");
-    buffptr = dev->unterminated_buffptr + dev->unterminated_size;
-
-    TRYZ(
-      error = copy_from_user(buffptr, buf, count),
-      "error while copying from user");
-
-    strncpy(msg_buffer, buffptr, count);
-    PDEBUG("writing %s", msg_buffer);
-
-    terminator_position = aesd_find_char(buffptr, count, TERMINATOR_CHARACTER);
-    if (terminator_position < 0) {
-      final_count = count;
-      dev->unterminated_size += final_count;
-    } else {
-      final_count = terminator_position + 1;
-      entry.buffptr = dev->unterminated_buffptr;
-      entry.size = dev->unterminated_size + final_count;
-      oldptr = aesd_circular_buffer_add_entry(&dev->buffer, &entry);
-      if (oldptr)
-        kfree(oldptr);
-      dev->unterminated_buffptr = NULL;
-      dev->unterminated_size = 0;
-    }
-
-    *f_pos += final_count;
-    retval = final_count;
-  }
+  struct aesd_file *file = filp->private_data;
+  __poll_t mask = EPOLLOUT | EPOLLWRNORM;
 
-done:
+  poll_wait(filp, &file->dev->wait, wait);
 
-  if (retval < 0) {
-    if (dev->unterminated_buffptr && dev->unterminated_size == 0) {
-      kfree(dev->unterminated_buffptr);
-      dev->unterminated_buffptr = NULL;
-    }
+  if (aesd_readable(file->dev, file, filp->f_pos))
+    mask |= EPOLLIN | EPOLLRDNORM;
 
-    if (error != 0) {
-      retval = -EFAULT;
-    }
-  }
-
-  mutex_unlock(&dev->lock);
-
-  return retval;
+  return mask;
 }
 
-loff_t
-aesd_llseek(struct file *filp, loff_t offset, int whence)
+int
+aesd_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-  struct aesd_dev *dev = filp->private_data;
-  loff_t retval = 0;
+  struct aesd_dev *dev = ((struct aesd_file *)filp->private_data)->dev;
 
-  PDEBUG("ENTERING LLSEEK");
-  PDEBUG("seeking offset %llu with whence %d\n", offset, whence);
-
-  if (mutex_lock_interruptible(&dev->lock))
-    return -ERESTARTSYS;
-
-  retval = fixed_size_llseek(
-    filp,
-    offset,
-    whence,
-    aesd_circular_buffer_size(&dev->buffer));
-
-  mutex_unlock(&dev->lock);
-  PDEBUG("new file offset: %llu\n", retval);
-  PDEBUG("EXITING LLSEEK");
-
-  return retval;
+  PDEBUG(
+    "mmap %lu bytes at page %lu",
+    vma->vm_end - vma->vm_start,
+    vma->vm_pgoff);
+
+  if (vma->vm_flags & VM_WRITE)
+    return -EACCES;
+  /* vm_flags is read-only since 6.3 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+  vm_flags_clear(vma, VM_MAYWRITE);
+#else
+  vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+  return remap_vmalloc_range(vma, dev->arena.base, vma->vm_pgoff);
 }
 
 long
 aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
   uint64_t local_64_arg;
+  uint32_t local_32_arg;
   long retval;
 
   switch (cmd) {
@@ -291,6 +145,19 @@ aesd_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
         retval = -EFAULT;
       }
       break;
+    case AESDCHAR_IOCFOLLOW:
+      PDEBUG("Executing ioctl AESDCHAR_IOCFOLLOW");
+      if (!get_user(local_32_arg, (uint32_t __user *)arg)) {
+        ((struct aesd_file *)filp->private_data)->follow = local_32_arg != 0;
+        retval = 0;
+      } else {
+        retval = -EFAULT;
+      }
+      break;
+    case AESDCHAR_IOCGETINDEX:
+      PDEBUG("Executing ioctl AESDCHAR_IOCGETINDEX");
+      retval = aesd_iocgetindex(filp, (struct aesd_index __user *)arg);
+      break;
     default:
       retval = -ENOTTY;
   }
@@ -302,16 +169,18 @@ struct file_operations aesd_fops = {
   .owner = THIS_MODULE,
   .llseek = aesd_llseek,
   .read = aesd_read,
-  .write = aesd_write,
+  .write_iter = aesd_write_iter,
   .unlocked_ioctl = aesd_ioctl,
+  .mmap = aesd_mmap,
+  .poll = aesd_poll,
   .open = aesd_open,
   .release = aesd_release,
 };
 
-static int
-aesd_setup_cdev(struct aesd_dev *dev)
+int
+aesd_setup_cdev(struct aesd_dev *dev, unsigned int index)
 {
-  int err, devno = MKDEV(aesd_major, aesd_minor);
+  int err, devno = MKDEV(aesd_major, aesd_minor + index);
 
   cdev_init(&dev->cdev, &aesd_fops);
   dev->cdev.owner = THIS_MODULE;
@@ -322,31 +191,66 @@ done:
   return err;
 }
 
+void
+aesd_teardown(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < aesd_devs_added; ++i)
+    cdev_del(&aesd_devices[i].cdev);
+  aesd_devs_added = 0;
+
+  for (i = 0; i < aesd_devs_initialized; ++i)
+    aesd_dev_cleanup(&aesd_devices[i]);
+  aesd_devs_initialized = 0;
+
+  kfree(aesd_devices);
+  aesd_devices = NULL;
+}
+
 int
 aesd_init_module(void)
 {
   dev_t dev = 0;
-  int result;
+  int result = -EINVAL;
   int ok = -1;
+  unsigned int i;
+
+  TRY(aesd_nr_devs, "at least one device is needed");
 
   TRYC(
-    result = alloc_chrdev_region(&dev, aesd_minor, 1, "aesdchar"),
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs, "aesdchar"),
     "character device major number allocation failed");
   aesd_major = MAJOR(dev);
 
-  memset(&aesd_device, 0, sizeof(struct aesd_dev));
+  result = -ENOMEM;
+  TRY(
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL),
+    "device allocation failed");
 
-  mutex_init(&aesd_device.lock);
-  aesd_circular_buffer_init(&aesd_device.buffer);
+  for (i = 0; i < aesd_nr_devs; ++i) {
+    TRYC(
+      result = aesd_dev_init(&aesd_devices[i], aesd_arena_pages),
+      "device initialization failed");
+    ++aesd_devs_initialized;
+  }
 
-  TRYC(result = aesd_setup_cdev(&aesd_device), "character device setup failed");
+  /* Devices go live on cdev_add, so only once they are all initialized. */
+  for (i = 0; i < aesd_nr_devs; ++i) {
+    TRYC(
+      result = aesd_setup_cdev(&aesd_devices[i], i),
+      "character device setup failed");
+    ++aesd_devs_added;
+  }
 
   ok = result;
 
 done:
   if (ok < 0) {
+    aesd_teardown();
+
     if (dev) {
-      unregister_chrdev_region(dev, 1);
+      unregister_chrdev_region(dev, aesd_nr_devs);
     }
 
     if (result < 0) {
@@ -361,22 +265,10 @@ void
 aesd_cleanup_module(void)
 {
   dev_t devno = MKDEV(aesd_major, aesd_minor);
-  struct aesd_buffer_entry *entryptr = NULL;
-  uint8_t index = 0;
-
-  cdev_del(&aesd_device.cdev);
 
-  if (aesd_device.unterminated_buffptr)
-    kfree(aesd_device.unterminated_buffptr);
-
-  AESD_CIRCULAR_BUFFER_FOREACH(entryptr, &aesd_device.buffer, index)
-  {
-    if (entryptr->buffptr) {
-      kfree(entryptr->buffptr);
-    }
-  };
+  aesd_teardown();
 
-  unregister_chrdev_region(devno, 1);
+  unregister_chrdev_region(devno, aesd_nr_devs);
 }
 
 module_init(aesd_init_module);
@@ -0,0 +1,206 @@
+/**
+ * @file aesd-ring-bench.c
+ * @brief Throughput of the aesd-ring.h specialisations
+ *
+ * Times push/pop pairs on the single threaded rings, with a power of two and
+ * with an arbitrary capacity, and transfers through the lock free rings with
+ * one consumer and a growing number of producers.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "aesd-ring.h"
+
+#define DEFAULT_OPERATIONS 10000000
+#define MAX_PRODUCERS 8
+
+AESD_RING_DEFINE(pow2_ring, size_t, 16)
+AESD_RING_DEFINE(odd_ring, size_t, 10)
+AESD_RING_DEFINE_GROWABLE(growable_ring, size_t, 16)
+AESD_RING_DEFINE_SPSC(spsc_ring, size_t, 1024)
+AESD_RING_DEFINE_MPSC(mpsc_ring, size_t, 1024)
+
+struct bench_transfer
+{
+  struct spsc_ring spsc;
+  struct mpsc_ring mpsc;
+  size_t items_per_producer;
+};
+typedef struct bench_transfer bench_transfer_t;
+
+static uint64_t
+bench_now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void
+bench_report(const char *name, unsigned producers, size_t items, uint64_t ns)
+{
+  printf(
+    "%-14s %9u %12.1f %10.2f\n",
+    name,
+    producers,
+    items * 1e3 / ns,
+    (double)ns / items);
+}
+
+/* Keeps the ring half full so both pushes and pops wrap around. */
+#define BENCH_SINGLE_THREADED(name, operations, cleanup)                       \
+  do {                                                                         \
+    struct name ring;                                                          \
+    size_t value = 0;                                                          \
+    size_t sum = 0;                                                            \
+    uint64_t start;                                                            \
+                                                                               \
+    name##_init(&ring);                                                        \
+    for (size_t i = 0; i < 8; ++i)                                             \
+      name##_push(&ring, &i);                                                  \
+                                                                               \
+    start = bench_now_ns();                                                    \
+    for (size_t i = 0; i < (operations); ++i) {                                \
+      name##_push(&ring, &i);                                                  \
+      name##_pop(&ring, &value);                                               \
+      sum += value;                                                            \
+    }                                                                          \
+    bench_report(#name, 0, (operations), bench_now_ns() - start);              \
+                                                                               \
+    if (sum == 0)                                                              \
+      putchar('\n');                                                           \
+                                                                               \
+    cleanup;                                                                   \
+  } while (0)
+
+static void *
+bench_spsc_producer(void *arg)
+{
+  bench_transfer_t *transfer = arg;
+
+  for (size_t i = 0; i < transfer->items_per_producer; ++i) {
+    while (!spsc_ring_push(&transfer->spsc, &i))
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+static void *
+bench_mpsc_producer(void *arg)
+{
+  bench_transfer_t *transfer = arg;
+
+  for (size_t i = 0; i < transfer->items_per_producer; ++i) {
+    while (!mpsc_ring_push(&transfer->mpsc, &i))
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+static bool
+bench_transfer(
+  bench_transfer_t *transfer,
+  bool spsc,
+  unsigned producers,
+  size_t operations)
+{
+  pthread_t tids[MAX_PRODUCERS];
+  unsigned started = 0;
+  size_t items;
+  size_t value;
+  uint64_t start;
+
+  spsc_ring_init(&transfer->spsc);
+  mpsc_ring_init(&transfer->mpsc);
+  transfer->items_per_producer = operations / producers;
+  items = transfer->items_per_producer * producers;
+
+  start = bench_now_ns();
+  for (; started < producers; ++started) {
+    if (pthread_create(
+          &tids[started],
+          NULL,
+          spsc ? bench_spsc_producer : bench_mpsc_producer,
+          transfer))
+      break;
+  }
+
+  for (size_t i = 0; started == producers && i < items; ++i) {
+    while (spsc ? !spsc_ring_pop(&transfer->spsc, &value)
+                : !mpsc_ring_pop(&transfer->mpsc, &value))
+      sched_yield();
+  }
+
+  for (unsigned i = 0; i < started; ++i)
+    pthread_join(tids[i], NULL);
+
+  if (started != producers)
+    return false;
+
+  bench_report(
+    spsc ? "spsc" : "mpsc",
+    producers,
+    items,
+    bench_now_ns() - start);
+
+  return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+  size_t operations = DEFAULT_OPERATIONS;
+  bench_transfer_t *transfer = NULL;
+  int exit_status = EXIT_FAILURE;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:")) != -1) {
+    switch (option) {
+      case 'n':
+        operations = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n operations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (!(transfer = aligned_alloc(
+          AESD_RING_CACHELINE_SIZE,
+          sizeof(bench_transfer_t))))
+    return EXIT_FAILURE;
+
+  printf("%-14s %9s %12s %10s\n", "ring", "producers", "Mops/s", "ns/op");
+
+  BENCH_SINGLE_THREADED(pow2_ring, operations, (void)ring);
+  BENCH_SINGLE_THREADED(odd_ring, operations, (void)ring);
+  BENCH_SINGLE_THREADED(
+    growable_ring,
+    operations,
+    growable_ring_finalize(&ring));
+
+  if (!bench_transfer(transfer, true, 1, operations))
+    goto done;
+
+  for (unsigned producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+    if (!bench_transfer(transfer, false, producers, operations))
+      goto done;
+  }
+
+  exit_status = EXIT_SUCCESS;
+
+done:
+  free(transfer);
+
+  return exit_status;
+}
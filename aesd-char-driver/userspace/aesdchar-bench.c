@@ -0,0 +1,342 @@
+/**
+ * @file aesdchar-bench.c
+ * @brief Throughput and latency of the aesd char driver core in user space
+ *
+ * Runs every operation against a device built from aesd-device.c on top of
+ * the aesd-compat.h stand-ins, for several arena capacities and record sizes,
+ * and prints operations per second and latency percentiles. Optional reader
+ * threads keep reading the whole history while the writes are measured.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aesd-compat.h"
+#include "aesd_ioctl.h"
+#include "aesdchar.h"
+
+#define DEFAULT_OPERATIONS 100000
+#define BATCH_RECORDS 16
+#define READ_BUFFER_SIZE 4096
+
+static const size_t arena_pages_list[] = { 4, 64, 1024 };
+static const size_t record_size_list[] = { 16, 256, 4096 };
+
+struct bench_context
+{
+  struct aesd_dev dev;
+  size_t record_size;
+  char *record;
+  volatile bool stop;
+};
+typedef struct bench_context bench_context_t;
+
+typedef void (*bench_operation_t)(bench_context_t *context, struct file *filp);
+
+static uint64_t
+bench_now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int
+bench_compare_u64(const void *left, const void *right)
+{
+  uint64_t left_value = *(const uint64_t *)left;
+  uint64_t right_value = *(const uint64_t *)right;
+
+  return (left_value > right_value) - (left_value < right_value);
+}
+
+static uint64_t
+bench_percentile(const uint64_t *sorted, size_t count, double percentile)
+{
+  size_t index = (size_t)(percentile / 100.0 * (count - 1) + 0.5);
+
+  return sorted[index];
+}
+
+static void
+bench_open(bench_context_t *context, struct aesd_file *file, struct file *filp)
+{
+  aesd_file_init(file, &context->dev);
+  memset(filp, 0, sizeof(struct file));
+  filp->private_data = file;
+}
+
+static void
+bench_write(bench_context_t *context, struct file *filp)
+{
+  struct iovec iov = { context->record, context->record_size };
+  struct kiocb iocb = { filp, filp->f_pos };
+  struct iov_iter iter;
+
+  aesd_iov_iter_init(&iter, &iov, 1);
+  aesd_write_iter(&iocb, &iter);
+}
+
+static void
+bench_writev(bench_context_t *context, struct file *filp)
+{
+  struct iovec iov[BATCH_RECORDS];
+  struct kiocb iocb = { filp, filp->f_pos };
+  struct iov_iter iter;
+
+  for (size_t i = 0; i < BATCH_RECORDS; ++i) {
+    iov[i].iov_base = context->record;
+    iov[i].iov_len = context->record_size;
+  }
+
+  aesd_iov_iter_init(&iter, iov, BATCH_RECORDS);
+  aesd_write_iter(&iocb, &iter);
+}
+
+static void
+bench_read_all(bench_context_t *context, struct file *filp)
+{
+  char buffer[READ_BUFFER_SIZE];
+
+  aesd_llseek(filp, 0, SEEK_SET);
+  while (aesd_read(filp, buffer, READ_BUFFER_SIZE, &filp->f_pos) > 0)
+    ;
+}
+
+static void
+bench_seekto(bench_context_t *context, struct file *filp)
+{
+  aesd_iocseekto(
+    filp,
+    rand() % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+    rand() % context->record_size);
+}
+
+static void
+bench_getindex(bench_context_t *context, struct file *filp)
+{
+  struct aesd_index index;
+
+  aesd_iocgetindex(filp, &index);
+}
+
+static void *
+bench_reader_thread(void *arg)
+{
+  bench_context_t *context = arg;
+  struct aesd_file file;
+  struct file filp;
+
+  bench_open(context, &file, &filp);
+  while (!context->stop)
+    bench_read_all(context, &filp);
+  aesd_file_cleanup(&file);
+
+  return NULL;
+}
+
+static void
+bench_measure(
+  bench_context_t *context,
+  struct file *filp,
+  const char *name,
+  bench_operation_t operation,
+  size_t records_per_operation,
+  size_t operations,
+  size_t arena_pages,
+  uint64_t *latencies)
+{
+  uint64_t start;
+  uint64_t total = 0;
+
+  for (size_t i = 0; i < operations; ++i) {
+    start = bench_now_ns();
+    operation(context, filp);
+    latencies[i] = bench_now_ns() - start;
+    total += latencies[i];
+  }
+
+  qsort(latencies, operations, sizeof(uint64_t), bench_compare_u64);
+
+  printf(
+    "%-8s %8zu %8zu %12.0f %12.0f %8lu %8lu %8lu\n",
+    name,
+    arena_pages,
+    context->record_size,
+    operations * 1e9 / total,
+    operations * records_per_operation * context->record_size * 1e9 / total /
+      (1 << 20),
+    bench_percentile(latencies, operations, 50),
+    bench_percentile(latencies, operations, 99),
+    bench_percentile(latencies, operations, 99.9));
+}
+
+static bool
+bench_run(
+  size_t arena_pages,
+  size_t record_size,
+  size_t operations,
+  unsigned readers,
+  uint64_t *latencies)
+{
+  bool ok = false;
+  bench_context_t context;
+  struct aesd_file file;
+  struct file filp;
+  pthread_t reader_tids[readers];
+  unsigned started_readers = 0;
+
+  memset(&context, 0, sizeof(bench_context_t));
+  context.record_size = record_size;
+
+  if (!(context.record = malloc(record_size)))
+    return false;
+  memset(context.record, 'a' + record_size % 26, record_size - 1);
+  context.record[record_size - 1] = '\n';
+
+  if (aesd_dev_init(&context.dev, arena_pages) < 0)
+    goto done;
+  bench_open(&context, &file, &filp);
+
+  for (; started_readers < readers; ++started_readers) {
+    if (pthread_create(
+          &reader_tids[started_readers],
+          NULL,
+          bench_reader_thread,
+          &context))
+      goto stop;
+  }
+
+  bench_measure(
+    &context,
+    &filp,
+    "write",
+    bench_write,
+    1,
+    operations,
+    arena_pages,
+    latencies);
+  bench_measure(
+    &context,
+    &filp,
+    "writev",
+    bench_writev,
+    BATCH_RECORDS,
+    operations / BATCH_RECORDS,
+    arena_pages,
+    latencies);
+  bench_measure(
+    &context,
+    &filp,
+    "read",
+    bench_read_all,
+    AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+    operations / AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+    arena_pages,
+    latencies);
+  bench_measure(
+    &context,
+    &filp,
+    "seekto",
+    bench_seekto,
+    0,
+    operations,
+    arena_pages,
+    latencies);
+  bench_measure(
+    &context,
+    &filp,
+    "index",
+    bench_getindex,
+    0,
+    operations,
+    arena_pages,
+    latencies);
+
+  ok = true;
+
+stop:
+  context.stop = true;
+  for (unsigned i = 0; i < started_readers; ++i)
+    pthread_join(reader_tids[i], NULL);
+
+  aesd_file_cleanup(&file);
+  aesd_dev_cleanup(&context.dev);
+
+done:
+  free(context.record);
+
+  return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+  size_t operations = DEFAULT_OPERATIONS;
+  unsigned readers = 0;
+  uint64_t *latencies = NULL;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:r:")) != -1) {
+    switch (option) {
+      case 'n':
+        operations = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        readers = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n operations] [-r readers]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (operations < BATCH_RECORDS * AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+    fprintf(
+      stderr,
+      "at least %d operations are needed\n",
+      BATCH_RECORDS * AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED);
+    return EXIT_FAILURE;
+  }
+
+  if (!(latencies = malloc(operations * sizeof(uint64_t))))
+    return EXIT_FAILURE;
+
+  printf(
+    "%-8s %8s %8s %12s %12s %8s %8s %8s\n",
+    "op",
+    "pages",
+    "record",
+    "ops/s",
+    "MiB/s",
+    "p50(ns)",
+    "p99(ns)",
+    "p999(ns)");
+
+  for (size_t i = 0; i < sizeof(arena_pages_list) / sizeof(size_t); ++i) {
+    for (size_t j = 0; j < sizeof(record_size_list) / sizeof(size_t); ++j) {
+      if (record_size_list[j] > arena_pages_list[i] * PAGE_SIZE)
+        continue;
+
+      if (!bench_run(
+            arena_pages_list[i],
+            record_size_list[j],
+            operations,
+            readers,
+            latencies)) {
+        free(latencies);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  free(latencies);
+
+  return EXIT_SUCCESS;
+}
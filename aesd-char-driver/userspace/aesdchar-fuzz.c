@@ -0,0 +1,539 @@
+/**
+ * @file aesdchar-fuzz.c
+ * @brief Differential fuzzer of the aesd char driver core in user space
+ *
+ * Each input is decoded as a sequence of writes, reads, seeks and index
+ * requests on a few open files of two devices, and every observable result is
+ * compared against a plain model of the committed records. Writes of a record
+ * larger than both arenas must commit the records before it as a short write,
+ * then fail with EFBIG when retried, dropping the record. The large device
+ * always holds the last AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED records; the
+ * small one evicts for space too, so it must hold some suffix of them.
+ *
+ * Built with -DAESD_LIBFUZZER and -fsanitize=fuzzer this is a libFuzzer
+ * target. Otherwise main either replays the files given as arguments or runs
+ * random inputs: aesdchar-fuzz [-s seed] [-n iterations] [file...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aesd-compat.h"
+#include "aesd_ioctl.h"
+#include "aesdchar.h"
+
+#define FUZZ_FILES 3
+#define FUZZ_MAX_WRITE 512
+#define FUZZ_LARGE_ARENA_PAGES 8
+#define FUZZ_SMALL_ARENA_PAGES 1
+#define FUZZ_MODEL_RECORDS AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
+#define FUZZ_MAX_RECORD_SIZE (FUZZ_MAX_WRITE * 4)
+
+#define FUZZ_CHECK(condition)                                                  \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(                                                                 \
+        stderr,                                                                \
+        "%s:%d: check failed: %s\n",                                           \
+        __FILE__,                                                              \
+        __LINE__,                                                              \
+        #condition);                                                           \
+      abort();                                                                 \
+    }                                                                          \
+  } while (0)
+
+enum fuzz_operation
+{
+  FUZZ_WRITE,
+  FUZZ_WRITEV,
+  FUZZ_WRITE_OVERSIZED,
+  FUZZ_READ,
+  FUZZ_SEEKTO,
+  FUZZ_GETINDEX,
+  FUZZ_REOPEN,
+  FUZZ_OPERATIONS
+};
+
+struct fuzz_record
+{
+  char data[FUZZ_MAX_RECORD_SIZE];
+  size_t size;
+};
+
+struct fuzz_model
+{
+  /* Last committed records, oldest first */
+  struct fuzz_record records[FUZZ_MODEL_RECORDS];
+  size_t count;
+  /* Records ever committed, the generation of the devices */
+  uint64_t committed;
+  /* Unterminated bytes written on each file */
+  char pending[FUZZ_FILES][FUZZ_MAX_RECORD_SIZE];
+  size_t pending_size[FUZZ_FILES];
+};
+
+struct fuzz_device
+{
+  struct aesd_dev dev;
+  struct aesd_file files[FUZZ_FILES];
+  struct file filps[FUZZ_FILES];
+  /* Whether dev holds exactly the last model records */
+  bool exact;
+};
+
+struct fuzz_input
+{
+  const uint8_t *data;
+  size_t size;
+};
+
+static struct fuzz_model model;
+static struct fuzz_device devices[2];
+
+static uint8_t
+fuzz_next(struct fuzz_input *input)
+{
+  uint8_t result = 0;
+
+  if (input->size) {
+    result = *input->data++;
+    --input->size;
+  }
+
+  return result;
+}
+
+static void
+fuzz_model_commit(const char *data, size_t size)
+{
+  struct fuzz_record *record;
+
+  if (model.count == FUZZ_MODEL_RECORDS) {
+    memmove(
+      &model.records[0],
+      &model.records[1],
+      (FUZZ_MODEL_RECORDS - 1) * sizeof(struct fuzz_record));
+    --model.count;
+  }
+
+  record = &model.records[model.count++];
+  memcpy(record->data, data, size);
+  record->size = size;
+  ++model.committed;
+}
+
+/* Mirrors aesd_write_iter: whole records are committed, the rest is kept. */
+static void
+fuzz_model_write(unsigned file, const char *data, size_t size)
+{
+  char *pending = model.pending[file];
+  size_t *pending_size = &model.pending_size[file];
+  size_t start = 0;
+
+  FUZZ_CHECK(*pending_size + size <= FUZZ_MAX_RECORD_SIZE);
+  memcpy(pending + *pending_size, data, size);
+  *pending_size += size;
+
+  for (size_t i = 0; i < *pending_size; ++i) {
+    if (pending[i] == '\n') {
+      fuzz_model_commit(pending + start, i + 1 - start);
+      start = i + 1;
+    }
+  }
+
+  *pending_size -= start;
+  memmove(pending, pending + start, *pending_size);
+}
+
+/* Index of the oldest model record held by the device */
+static size_t
+fuzz_first_record(struct fuzz_device *device)
+{
+  struct aesd_index index;
+  size_t first;
+
+  FUZZ_CHECK(aesd_iocgetindex(&device->filps[0], &index) == 0);
+  FUZZ_CHECK(index.generation == model.committed);
+  FUZZ_CHECK(index.entry_count <= model.count);
+
+  if (device->exact)
+    FUZZ_CHECK(index.entry_count == model.count);
+
+  first = model.count - index.entry_count;
+  for (uint32_t i = 0; i < index.entry_count; ++i) {
+    FUZZ_CHECK(index.entry[i].write_cmd == i);
+    FUZZ_CHECK(index.entry[i].size == model.records[first + i].size);
+  }
+
+  return first;
+}
+
+static void
+fuzz_write(struct fuzz_input *input, unsigned file, unsigned segments)
+{
+  char data[FUZZ_MAX_WRITE];
+  struct iovec iov[4];
+  struct iov_iter iter;
+  struct kiocb iocb;
+  size_t size = 0;
+  size_t length;
+  uint8_t byte;
+
+  for (unsigned i = 0; i < segments; ++i) {
+    length = fuzz_next(input) % (FUZZ_MAX_WRITE / segments);
+    iov[i].iov_base = data + size;
+    iov[i].iov_len = length;
+
+    for (size_t j = 0; j < length; ++j) {
+      byte = fuzz_next(input);
+      data[size + j] = byte % 8 == 0 ? '\n' : 'a' + byte % 26;
+    }
+    size += length;
+  }
+
+  if (model.pending_size[file] + size > FUZZ_MAX_RECORD_SIZE)
+    return;
+
+  for (unsigned d = 0; d < 2; ++d) {
+    iocb.ki_filp = &devices[d].filps[file];
+    iocb.ki_pos = iocb.ki_filp->f_pos;
+    aesd_iov_iter_init(&iter, iov, segments);
+    FUZZ_CHECK(aesd_write_iter(&iocb, &iter) == (ssize_t)size);
+  }
+
+  fuzz_model_write(file, data, size);
+}
+
+/*
+ * Writes a few records then one larger than both arenas, with or without its
+ * terminator, and retries the rest after a short write like write(2) callers.
+ */
+static void
+fuzz_write_oversized(struct fuzz_input *input, unsigned file)
+{
+  size_t oversized_size = devices[0].dev.arena.data_size + 1;
+  size_t prefix_size = fuzz_next(input) % FUZZ_MAX_WRITE;
+  size_t size = prefix_size + oversized_size + fuzz_next(input) % 2;
+  char *data = malloc(size);
+  struct iovec iov;
+  struct iov_iter iter;
+  struct kiocb iocb;
+  ssize_t expected = -EFBIG;
+  uint8_t byte;
+
+  FUZZ_CHECK(data);
+  if (model.pending_size[file] + prefix_size > FUZZ_MAX_RECORD_SIZE)
+    goto done;
+
+  for (size_t i = 0; i < prefix_size; ++i) {
+    byte = fuzz_next(input);
+    data[i] = byte % 8 == 0 ? '\n' : 'a' + byte % 26;
+  }
+  memset(data + prefix_size, 'x', size - prefix_size);
+  data[size - 1] = size > prefix_size + oversized_size ? '\n' : 'x';
+
+  /* Up to the last terminator before the oversized record */
+  for (size_t i = prefix_size; i > 0; --i) {
+    if (data[i - 1] == '\n') {
+      expected = i;
+      break;
+    }
+  }
+
+  for (unsigned d = 0; d < 2; ++d) {
+    iocb.ki_filp = &devices[d].filps[file];
+    iocb.ki_pos = iocb.ki_filp->f_pos;
+    iov.iov_base = data;
+    iov.iov_len = size;
+    aesd_iov_iter_init(&iter, &iov, 1);
+    FUZZ_CHECK(aesd_write_iter(&iocb, &iter) == expected);
+
+    if (expected > 0) {
+      iov.iov_base = data + expected;
+      iov.iov_len = size - expected;
+      aesd_iov_iter_init(&iter, &iov, 1);
+      FUZZ_CHECK(aesd_write_iter(&iocb, &iter) == -EFBIG);
+    }
+  }
+
+  if (expected > 0)
+    fuzz_model_write(file, data, expected);
+  model.pending_size[file] = 0;
+
+done:
+  free(data);
+}
+
+static void
+fuzz_read(struct fuzz_input *input, unsigned file)
+{
+  char expected[FUZZ_MODEL_RECORDS * FUZZ_MAX_RECORD_SIZE];
+  char actual[FUZZ_MODEL_RECORDS * FUZZ_MAX_RECORD_SIZE];
+  size_t chunk = fuzz_next(input) % 64 + 1;
+  struct fuzz_device *device;
+  struct file *filp;
+  size_t expected_size;
+  size_t actual_size;
+  ssize_t result;
+  loff_t position;
+
+  for (unsigned d = 0; d < 2; ++d) {
+    device = &devices[d];
+    filp = &device->filps[file];
+    expected_size = 0;
+    actual_size = 0;
+
+    for (size_t i = fuzz_first_record(device); i < model.count; ++i) {
+      memcpy(
+        expected + expected_size,
+        model.records[i].data,
+        model.records[i].size);
+      expected_size += model.records[i].size;
+    }
+
+    /*
+     * A plain reader at the end reads nothing and is not readable, even at a
+     * position given by pread, which no seek resynchronized.
+     */
+    position = expected_size;
+    FUZZ_CHECK(aesd_read(filp, actual, chunk, &position) == 0);
+    FUZZ_CHECK(!aesd_readable(&device->dev, filp->private_data, position));
+
+    FUZZ_CHECK(aesd_llseek(filp, 0, SEEK_SET) == 0);
+    do {
+      result = aesd_read(filp, actual + actual_size, chunk, &filp->f_pos);
+      FUZZ_CHECK(result >= 0);
+      actual_size += result;
+      FUZZ_CHECK(actual_size <= expected_size);
+    } while (result > 0);
+
+    FUZZ_CHECK(actual_size == expected_size);
+    FUZZ_CHECK(!memcmp(actual, expected, expected_size));
+
+    FUZZ_CHECK(aesd_llseek(filp, 0, SEEK_END) == (loff_t)expected_size);
+    FUZZ_CHECK(aesd_read(filp, actual, chunk, &filp->f_pos) == 0);
+  }
+}
+
+static void
+fuzz_seekto(struct fuzz_input *input, unsigned file)
+{
+  uint32_t write_cmd = fuzz_next(input) % (FUZZ_MODEL_RECORDS + 2);
+  uint32_t write_cmd_offset = fuzz_next(input) * 4;
+  struct fuzz_device *device;
+  size_t first;
+  long expected;
+
+  for (unsigned d = 0; d < 2; ++d) {
+    device = &devices[d];
+    first = fuzz_first_record(device);
+    expected = -EINVAL;
+
+    if (
+      first + write_cmd < model.count &&
+      write_cmd_offset < model.records[first + write_cmd].size) {
+      expected = write_cmd_offset;
+      for (size_t i = first; i < first + write_cmd; ++i)
+        expected += model.records[i].size;
+    }
+
+    FUZZ_CHECK(
+      aesd_iocseekto(&device->filps[file], write_cmd, write_cmd_offset) ==
+      expected);
+
+    if (expected >= 0)
+      FUZZ_CHECK(device->filps[file].f_pos == expected);
+  }
+}
+
+/* The mapped header must describe the same records as the index. */
+static void
+fuzz_getindex(void)
+{
+  struct aesd_mmap_header *header;
+  struct fuzz_device *device;
+  size_t first;
+
+  for (unsigned d = 0; d < 2; ++d) {
+    device = &devices[d];
+    header = device->dev.arena.header;
+    first = fuzz_first_record(device);
+
+    FUZZ_CHECK(header->generation % 2 == 0);
+    FUZZ_CHECK(header->entry_count == model.count - first);
+    FUZZ_CHECK(header->data_size == device->dev.arena.data_size);
+
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+      FUZZ_CHECK(
+        header->entry[i].offset + header->entry[i].size <= header->data_size);
+      FUZZ_CHECK(header->entry[i].size == model.records[first + i].size);
+      FUZZ_CHECK(!memcmp(
+        (char *)device->dev.arena.base + header->data_offset +
+          header->entry[i].offset,
+        model.records[first + i].data,
+        header->entry[i].size));
+    }
+  }
+}
+
+static void
+fuzz_open(struct fuzz_device *device, unsigned file)
+{
+  aesd_file_init(&device->files[file], &device->dev);
+  memset(&device->filps[file], 0, sizeof(struct file));
+  device->filps[file].private_data = &device->files[file];
+}
+
+static void
+fuzz_reopen(unsigned file)
+{
+  for (unsigned d = 0; d < 2; ++d) {
+    aesd_file_cleanup(&devices[d].files[file]);
+    fuzz_open(&devices[d], file);
+  }
+
+  model.pending_size[file] = 0;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  struct fuzz_input input = { data, size };
+  const size_t arena_pages[2] = { FUZZ_LARGE_ARENA_PAGES,
+                                  FUZZ_SMALL_ARENA_PAGES };
+  uint8_t operation;
+  unsigned file;
+
+  memset(&model, 0, sizeof(struct fuzz_model));
+
+  for (unsigned d = 0; d < 2; ++d) {
+    FUZZ_CHECK(aesd_dev_init(&devices[d].dev, arena_pages[d]) == 0);
+    devices[d].exact = d == 0;
+
+    for (file = 0; file < FUZZ_FILES; ++file)
+      fuzz_open(&devices[d], file);
+  }
+
+  while (input.size) {
+    operation = fuzz_next(&input);
+    file = (operation / FUZZ_OPERATIONS) % FUZZ_FILES;
+
+    switch (operation % FUZZ_OPERATIONS) {
+      case FUZZ_WRITE:
+        fuzz_write(&input, file, 1);
+        break;
+      case FUZZ_WRITEV:
+        fuzz_write(&input, file, fuzz_next(&input) % 4 + 1);
+        break;
+      case FUZZ_WRITE_OVERSIZED:
+        fuzz_write_oversized(&input, file);
+        break;
+      case FUZZ_READ:
+        fuzz_read(&input, file);
+        break;
+      case FUZZ_SEEKTO:
+        fuzz_seekto(&input, file);
+        break;
+      case FUZZ_GETINDEX:
+        fuzz_getindex();
+        break;
+      case FUZZ_REOPEN:
+        fuzz_reopen(file);
+        break;
+    }
+  }
+
+  fuzz_getindex();
+
+  for (unsigned d = 0; d < 2; ++d) {
+    for (file = 0; file < FUZZ_FILES; ++file)
+      aesd_file_cleanup(&devices[d].files[file]);
+
+    aesd_dev_cleanup(&devices[d].dev);
+  }
+
+  return 0;
+}
+
+#ifndef AESD_LIBFUZZER
+
+static int
+fuzz_replay(const char *path)
+{
+  FILE *stream = fopen(path, "rb");
+  uint8_t *data = NULL;
+  long size;
+
+  if (!stream) {
+    perror(path);
+    return -1;
+  }
+
+  if (
+    fseek(stream, 0, SEEK_END) || (size = ftell(stream)) < 0 ||
+    fseek(stream, 0, SEEK_SET) || !(data = malloc(size ? size : 1)) ||
+    fread(data, 1, size, stream) != (size_t)size) {
+    perror(path);
+    free(data);
+    fclose(stream);
+    return -1;
+  }
+
+  fclose(stream);
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned seed = 1;
+  unsigned long iterations = 10000;
+  uint8_t data[4096];
+  size_t size;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:n:")) != -1) {
+    switch (option) {
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(
+          stderr,
+          "usage: %s [-s seed] [-n iterations] [file...]\n",
+          argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    for (int i = optind; i < argc; ++i) {
+      if (fuzz_replay(argv[i]) < 0)
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  srand(seed);
+  for (unsigned long i = 0; i < iterations; ++i) {
+    size = rand() % sizeof(data);
+    for (size_t j = 0; j < size; ++j)
+      data[j] = rand();
+
+    LLVMFuzzerTestOneInput(data, size);
+  }
+
+  printf("%lu inputs passed\n", iterations);
+
+  return EXIT_SUCCESS;
+}
+
+#endif /* AESD_LIBFUZZER */
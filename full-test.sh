@@ -6,7 +6,7 @@ set -e
 
 cd `dirname $0`
 test_dir=`pwd`
-echo "starting test with SKIP_BUILD=\"${SKIP_BUILD}\" and DO_VALIDATE=\"${DO_VALIDATE}\""
+echo "starting test with SKIP_BUILD=\"${SKIP_BUILD}\" DO_VALIDATE=\"${DO_VALIDATE}\" and PERF_GATE=\"${PERF_GATE}\""
 
 # This part of the script always runs as the current user, even when
 # executed inside a docker container.
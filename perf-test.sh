@@ -0,0 +1,191 @@
+#!/bin/bash
+# Performance regression gate
+#
+# Builds and runs the benchmarks of server/ (containers, concurrent_queue_t,
+# monitor_t and the aesdchar circular buffer) and times aesdsocket itself with
+# aesdsocket_loadgen: accepting connections appending lines, then streaming
+# the file back. Every result is compared with the baseline file, and the
+# script exits non-zero when a median got slower than its tolerance allows
+# by more than three standard errors of the difference. The reads stream every
+# line written so far, so compare results taken with the same PERF_RUNS.
+#
+# Environment:
+#   PERF_BASELINE          baseline file (default conf/perf-baseline.jsonl),
+#                          recorded from the current results when missing
+#   PERF_UPDATE_BASELINE=1 records the current results as the baseline
+#   PERF_TOLERANCE         default tolerance in percent (default 10)
+#   PERF_TOLERANCES        file of "<benchmark prefix> <percent>" lines, the
+#                          longest matching prefix wins
+#                          (default conf/perf-tolerances)
+#   PERF_RUNS              measured runs of each benchmark (default 10)
+#   PERF_CPU               CPU the benchmarks are pinned to (default 0)
+#   PERF_PORT              port of aesdsocket (default 9000)
+#   PERF_SKIP_BUILD=1      uses the binaries already built
+
+cd `dirname $0`
+
+baseline=${PERF_BASELINE:-conf/perf-baseline.jsonl}
+tolerances=${PERF_TOLERANCES:-conf/perf-tolerances}
+default_tolerance=${PERF_TOLERANCE:-10}
+runs=${PERF_RUNS:-10}
+cpu=${PERF_CPU:-0}
+port=${PERF_PORT:-9000}
+bench_dir=server/build/bench
+server=server/build/aesdsocket
+loadgen=server/build/aesdsocket_loadgen
+datafile=/var/tmp/aesdsocketdata
+server_records=1000
+results=`mktemp`
+server_pid=
+
+cleanup() {
+    if [ -n "${server_pid}" ]; then
+        kill ${server_pid} 2>/dev/null
+        wait ${server_pid} 2>/dev/null
+    fi
+    rm -f ${results} ${results}.loadgen
+}
+trap cleanup EXIT
+
+# Runs loadgen ${runs} times and summarises the time per request, taken from
+# the throughput, in the format of bench.h
+# $1: benchmark name, $2: param, $3...: loadgen options
+server_bench() {
+    local name=$1
+    local param=$2
+    shift 2
+
+    rm -f ${results}.loadgen
+    for run in `seq ${runs}`; do
+        ${loadgen} -p ${port} -j "$@" >> ${results}.loadgen || return 1
+    done
+
+    awk -v name="${name}" -v param=${param} '
+        match($0, /"requests": [0-9]+/) {
+            ops = substr($0, RSTART + 12, RLENGTH - 12)
+        }
+        match($0, /"requests_per_s": [0-9.]+/) {
+            samples[n++] = 1e9 / substr($0, RSTART + 18, RLENGTH - 18)
+        }
+        END {
+            for (i = 0; i < n; ++i) {
+                for (j = i + 1; j < n; ++j) {
+                    if (samples[j] < samples[i]) {
+                        t = samples[i]; samples[i] = samples[j]; samples[j] = t
+                    }
+                }
+                mean += samples[i] / n
+            }
+            for (i = 0; i < n; ++i)
+                variance += (samples[i] - mean) ^ 2
+            variance = n > 1 ? variance / (n - 1) : 0
+            median = n % 2 ? samples[int(n / 2)] \
+                           : (samples[n / 2 - 1] + samples[n / 2]) / 2
+            printf "{\"benchmark\": \"%s\", \"param\": %d, \"ops\": %d, " \
+                   "\"runs\": %d, \"min_ns\": %.3f, \"median_ns\": %.3f, " \
+                   "\"mean_ns\": %.3f, \"stddev_ns\": %.3f, " \
+                   "\"max_ns\": %.3f}\n", name, param, ops, n, samples[0], \
+                   median, mean, sqrt(variance), samples[n - 1]
+        }' ${results}.loadgen
+}
+
+if [ "${PERF_SKIP_BUILD}" != "1" ]; then
+    make -C server clean all bench loadgen > /dev/null || exit 1
+fi
+
+echo "Running the benchmarks"
+bench_options="-j -r ${runs} -c ${cpu}"
+for bench in microbench queue_bench concurrent_queue_bench; do
+    ${bench_dir}/${bench} ${bench_options} >> ${results} || exit 1
+done
+for bench in ${bench_dir}/circular_buffer_bench_*; do
+    ${bench} ${bench_options} >> ${results} || exit 1
+done
+
+echo "Running aesdsocket"
+rm -f ${datafile}
+${server} 2> /dev/null &
+server_pid=$!
+for attempt in `seq 50`; do
+    (exec 3<>/dev/tcp/127.0.0.1/${port}) 2>/dev/null && break
+    sleep 0.1
+done
+server_bench aesdsocket/write ${server_records} \
+    -c 4 -n ${server_records} -x 100:0:0 >> ${results} || exit 1
+server_bench aesdsocket/read 200 \
+    -c 4 -n 200 -x 0:100:0 >> ${results} || exit 1
+kill ${server_pid}
+wait ${server_pid}
+server_pid=
+rm -f ${datafile}
+
+if [ "${PERF_UPDATE_BASELINE}" == "1" ] || [ ! -f ${baseline} ]; then
+    cp ${results} ${baseline}
+    echo "Recorded the baseline in ${baseline}"
+    exit 0
+fi
+
+[ -f ${tolerances} ] || tolerances=/dev/null
+awk -v default_tolerance=${default_tolerance} '
+    function field(line, key,    value) {
+        if (!match(line, "\"" key "\": [^,}]+"))
+            return ""
+        value = substr(line, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+        gsub(/"/, "", value)
+        return value
+    }
+    function tolerance(name,    prefix, best, length_best) {
+        best = default_tolerance
+        length_best = -1
+        for (prefix in prefixes) {
+            if (index(name, prefix) == 1 && length(prefix) > length_best) {
+                best = prefixes[prefix]
+                length_best = length(prefix)
+            }
+        }
+        return best
+    }
+    FILENAME == ARGV[1] {
+        if ($0 !~ /^#/ && NF == 2)
+            prefixes[$1] = $2
+        next
+    }
+    {
+        key = field($0, "benchmark") " " field($0, "param")
+        if (FILENAME == ARGV[2]) {
+            base_median[key] = field($0, "median_ns")
+            base_stddev[key] = field($0, "stddev_ns")
+            base_runs[key] = field($0, "runs")
+            next
+        }
+        median = field($0, "median_ns")
+        if (!(key in base_median)) {
+            printf "%-52s %12s %12.2f %8s  new\n", key, "-", median, "-"
+            next
+        }
+        difference = median - base_median[key]
+        change = base_median[key] > 0 ? 100 * difference / base_median[key] : 0
+        noise = 3 * sqrt(base_stddev[key] ^ 2 / base_runs[key] + \
+                         field($0, "stddev_ns") ^ 2 / field($0, "runs"))
+        limit = base_median[key] * tolerance(key) / 100
+        status = "ok"
+        if (difference > limit && difference > noise) {
+            status = "REGRESSION"
+            ++regressions
+        } else if (-difference > limit && -difference > noise) {
+            status = "faster"
+        }
+        printf "%-52s %12.2f %12.2f %+7.1f%%  %s\n", key, base_median[key], \
+               median, change, status
+    }
+    BEGIN {
+        printf "%-52s %12s %12s %8s  %s\n", "benchmark param", "baseline(ns)", \
+               "median(ns)", "change", "status"
+    }
+    END {
+        if (regressions) {
+            printf "%d performance regression(s) against the baseline\n", \
+                   regressions
+            exit 1
+        }
+    }' ${tolerances} ${baseline} ${results}
@@ -0,0 +1,114 @@
+#!/bin/bash
+# End to end test of the range-read commands of aesdsocket
+#
+# Starts aesdsocket, appends a few records and checks the replies to
+# AESDSOCKET_READLAST and AESDSOCKET_READSINCE, in particular that ranges
+# past the newest record are empty. Records keep their number across device
+# evictions, so the number the next record will get is found by searching
+# for the first empty AESDSOCKET_READSINCE; on the regular file, which starts
+# empty, it must be the number of records appended.
+#
+# Environment:
+#   RANGE_DEVICE=1      builds aesdsocket on /dev/aesdchar, which must exist
+#   RANGE_PORT          port of aesdsocket (default 9000)
+#   RANGE_SKIP_BUILD=1  uses the binary already built
+
+cd `dirname $0`
+
+port=${RANGE_PORT:-9000}
+server=server/build/aesdsocket
+datafile=/var/tmp/aesdsocketdata
+records=3
+int64_max=9223372036854775807
+failures=0
+server_pid=
+
+cleanup() {
+    if [ -n "${server_pid}" ]; then
+        kill ${server_pid} 2>/dev/null
+        wait ${server_pid} 2>/dev/null
+    fi
+}
+trap cleanup EXIT
+
+# Prints the reply to the line $1
+request() {
+    exec 3<>/dev/tcp/127.0.0.1/${port} || return 1
+    printf '%s\n' "$1" >&3
+    cat <&3
+    exec 3<&-
+}
+
+# Replies are compared without their trailing newlines
+# $1: description, $2: expected reply, $3: actual reply
+check() {
+    if [ "$2" == "$3" ]; then
+        echo "ok      $1"
+    else
+        echo "FAILED  $1: expected '$2', got '$3'"
+        ((++failures))
+    fi
+}
+
+if [ "${RANGE_DEVICE}" == "1" ]; then
+    [ -c /dev/aesdchar ] || { echo "/dev/aesdchar is missing"; exit 1; }
+    cppflags=-DUSE_AESD_CHAR_DEVICE
+fi
+
+if [ "${RANGE_SKIP_BUILD}" != "1" ]; then
+    make -C server clean all ${cppflags:+CPPFLAGS=${cppflags}} > /dev/null ||
+        exit 1
+fi
+
+[ "${RANGE_DEVICE}" == "1" ] || rm -f ${datafile}*
+${server} 2> /dev/null &
+server_pid=$!
+for attempt in `seq 50`; do
+    (exec 3<>/dev/tcp/127.0.0.1/${port}) 2>/dev/null && break
+    sleep 0.1
+done
+
+for record in `seq ${records}`; do
+    request "range-test $$ ${record}" > /dev/null || exit 1
+done
+newest="range-test $$ ${records}"
+last_two="range-test $$ $((records - 1))"$'\n'${newest}
+
+check "READLAST:0 is empty" "" "`request AESDSOCKET_READLAST:0`"
+check "READLAST:1 is the newest record" "${newest}" \
+    "`request AESDSOCKET_READLAST:1`"
+check "READLAST:2 are the two newest records" "${last_two}" \
+    "`request AESDSOCKET_READLAST:2`"
+check "READSINCE:${int64_max} is empty" "" \
+    "`request AESDSOCKET_READSINCE:${int64_max}`"
+
+# The first empty READSINCE, which exists as the one above is empty
+low=0
+high=${int64_max}
+while [ ${low} -lt ${high} ]; do
+    middle=$((low + (high - low) / 2))
+    if [ -z "`request AESDSOCKET_READSINCE:${middle}`" ]; then
+        high=${middle}
+    else
+        low=$((middle + 1))
+    fi
+done
+next=${low}
+
+[ "${RANGE_DEVICE}" == "1" ] || check "next record number" ${records} ${next}
+check "READSINCE past the newest record is empty" "" \
+    "`request AESDSOCKET_READSINCE:${next}`"
+check "READSINCE of the newest record" "${newest}" \
+    "`request AESDSOCKET_READSINCE:$((next - 1))`"
+check "READSINCE of the two newest records" "${last_two}" \
+    "`request AESDSOCKET_READSINCE:$((next - 2))`"
+
+kill ${server_pid}
+wait ${server_pid}
+server_pid=
+[ "${RANGE_DEVICE}" == "1" ] || rm -f ${datafile}*
+
+if [ ${failures} -ne 0 ]; then
+    echo "${failures} range-read check(s) failed"
+    exit 1
+fi
@@ -0,0 +1,247 @@
+/**
+ * @file bench.h
+ * @brief Shared harness of the microbenchmarks
+ *
+ * A benchmark function runs a given number of operations and reports how long
+ * the measured part took, so that it can leave its setup out. bench_run calls
+ * it a few times to warm up, then once per measured run, and summarises the
+ * nanoseconds per operation of the runs: min, median, mean, standard
+ * deviation and max. Results are printed as a table, or with -j as one JSON
+ * object per line for tools such as the perf gate of unit-test.sh.
+ *
+ * Its users define _GNU_SOURCE before any include, for CPU pinning.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_DEFAULT_WARMUP_RUNS 2
+
+struct bench_options
+{
+  bool json;
+  unsigned runs;
+  unsigned warmup_runs;
+  /* CPU the calling thread is pinned to, -1 to leave it to the scheduler */
+  int cpu;
+  /* Only benchmarks whose name contains it run */
+  const char *filter;
+  double scale;
+};
+typedef struct bench_options bench_options_t;
+
+/* Runs ops operations and stores the time taken by them in elapsed_ns. */
+typedef bool (*bench_fn_t)(void *context, size_t ops, uint64_t *elapsed_ns);
+
+/* Benchmarks add their results here so that the work is not optimised out. */
+static volatile uint64_t bench_sink;
+
+static inline uint64_t
+bench_now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Pins the calling thread to cpu modulo the number of online CPUs. */
+static inline void
+bench_pin_thread(int cpu)
+{
+  cpu_set_t set;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (cpu < 0 || cpus < 1)
+    return;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu % cpus, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+}
+
+static inline void
+bench_usage(const char *program)
+{
+  fprintf(
+    stderr,
+    "usage: %s [-j] [-r runs] [-w warmup_runs] [-c cpu] [-f filter] "
+    "[-s scale]\n"
+    "  -j  one JSON object per benchmark and line\n"
+    "  -c  CPU to pin to, -1 for none (default 0)\n"
+    "  -s  multiplies the number of operations per run (default 1)\n",
+    program);
+}
+
+static inline bool
+bench_parse_options(bench_options_t *options, int argc, char *argv[])
+{
+  int option;
+
+  options->json = false;
+  options->runs = BENCH_DEFAULT_RUNS;
+  options->warmup_runs = BENCH_DEFAULT_WARMUP_RUNS;
+  options->cpu = 0;
+  options->filter = NULL;
+  options->scale = 1;
+
+  while ((option = getopt(argc, argv, "jr:w:c:f:s:")) != -1) {
+    switch (option) {
+      case 'j':
+        options->json = true;
+        break;
+      case 'r':
+        options->runs = strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        options->warmup_runs = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        options->cpu = atoi(optarg);
+        break;
+      case 'f':
+        options->filter = optarg;
+        break;
+      case 's':
+        options->scale = strtod(optarg, NULL);
+        break;
+      default:
+        bench_usage(argv[0]);
+        return false;
+    }
+  }
+
+  if (options->runs == 0 || options->scale <= 0) {
+    bench_usage(argv[0]);
+    return false;
+  }
+
+  bench_pin_thread(options->cpu);
+
+  if (!options->json)
+    printf(
+      "%-44s %10s %10s %10s %10s %10s %10s\n",
+      "benchmark",
+      "param",
+      "min",
+      "median",
+      "mean",
+      "stddev",
+      "max");
+
+  return true;
+}
+
+static inline int
+bench_compare_doubles(const void *left, const void *right)
+{
+  double difference = *(const double *)left - *(const double *)right;
+
+  return (difference > 0) - (difference < 0);
+}
+
+/*
+ * Runs fn with ops operations, scaled by -s, and prints the summary of
+ * nanoseconds per operation. param tells apart the variants of a benchmark,
+ * such as element or thread counts. Returns false if fn fails.
+ */
+static inline bool
+bench_run(
+  const bench_options_t *options,
+  const char *name,
+  long param,
+  bench_fn_t fn,
+  void *context,
+  size_t ops)
+{
+  bool ok = false;
+  double *samples = NULL;
+  double mean = 0;
+  double variance = 0;
+  double median;
+  uint64_t elapsed_ns;
+  unsigned runs = options->runs;
+
+  if (options->filter && !strstr(name, options->filter))
+    return true;
+
+  ops = (size_t)(ops * options->scale);
+  if (ops == 0)
+    ops = 1;
+
+  if (!(samples = malloc(runs * sizeof(double))))
+    goto done;
+
+  for (unsigned i = 0; i < options->warmup_runs; ++i) {
+    if (!fn(context, ops, &elapsed_ns))
+      goto done;
+  }
+
+  for (unsigned i = 0; i < runs; ++i) {
+    if (!fn(context, ops, &elapsed_ns))
+      goto done;
+    samples[i] = (double)elapsed_ns / ops;
+    mean += samples[i];
+  }
+  mean /= runs;
+
+  for (unsigned i = 0; i < runs; ++i)
+    variance += (samples[i] - mean) * (samples[i] - mean);
+  variance = runs > 1 ? variance / (runs - 1) : 0;
+
+  qsort(samples, runs, sizeof(double), bench_compare_doubles);
+  median = runs % 2 ? samples[runs / 2]
+                    : (samples[runs / 2 - 1] + samples[runs / 2]) / 2;
+
+  if (options->json)
+    printf(
+      "{\"benchmark\": \"%s\", \"param\": %ld, \"ops\": %zu, \"runs\": %u, "
+      "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+      "\"stddev_ns\": %.3f, \"max_ns\": %.3f}\n",
+      name,
+      param,
+      ops,
+      runs,
+      samples[0],
+      median,
+      mean,
+      sqrt(variance),
+      samples[runs - 1]);
+  else
+    printf(
+      "%-44s %10ld %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+      name,
+      param,
+      samples[0],
+      median,
+      mean,
+      sqrt(variance),
+      samples[runs - 1]);
+  fflush(stdout);
+
+  ok = true;
+
+done:
+  if (!ok)
+    fprintf(stderr, "%s %ld failed\n", name, param);
+
+  free(samples);
+
+  return ok;
+}
+
+#endif /* BENCH_H */
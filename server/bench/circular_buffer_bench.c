@@ -0,0 +1,158 @@
+/**
+ * @file circular_buffer_bench.c
+ * @brief Microbenchmarks of the circular buffer of aesdchar
+ *
+ * Built once per capacity, given by AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+ * which every result reports as its param. Times adding entries to a full
+ * buffer, which evicts the oldest one, and with the buffer full of entries of
+ * 1 to MAX_ENTRY_SIZE bytes, lookups of random file positions and of the file
+ * position of random entries. Run with -h for the options of bench.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "aesd-circular-buffer.h"
+#include "bench.h"
+
+#define MAX_ENTRY_SIZE 64
+#define CIRCULAR_BUFFER_OPS 1000000
+
+static const char entry_data[MAX_ENTRY_SIZE];
+
+/* Fills buffer and returns the total size of its entries. */
+static size_t
+bench_circular_buffer_fill(struct aesd_circular_buffer *buffer)
+{
+  struct aesd_buffer_entry entry = { .buffptr = entry_data };
+  size_t total = 0;
+
+  aesd_circular_buffer_init(buffer);
+  for (size_t i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; ++i) {
+    entry.size = 1 + (i * 37) % MAX_ENTRY_SIZE;
+    aesd_circular_buffer_add_entry(buffer, &entry);
+    total += entry.size;
+  }
+
+  return total;
+}
+
+static bool
+bench_add_entry(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct aesd_circular_buffer buffer;
+  struct aesd_buffer_entry entry = { .buffptr = entry_data };
+  uintptr_t sum = 0;
+  uint64_t start;
+
+  bench_circular_buffer_fill(&buffer);
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    entry.size = 1 + i % MAX_ENTRY_SIZE;
+    sum += (uintptr_t)aesd_circular_buffer_add_entry(&buffer, &entry);
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+
+  return true;
+}
+
+static bool
+bench_find_entry_offset_for_fpos(
+  void *context,
+  size_t ops,
+  uint64_t *elapsed_ns)
+{
+  struct aesd_circular_buffer buffer;
+  size_t total = bench_circular_buffer_fill(&buffer);
+  size_t entry_offset;
+  size_t sum = 0;
+  uint64_t start;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    if (!aesd_circular_buffer_find_entry_offset_for_fpos(
+          &buffer,
+          (i * UINT64_C(2654435761)) % total,
+          &entry_offset))
+      return false;
+    sum += entry_offset;
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+
+  return true;
+}
+
+static bool
+bench_find_fpos_for_entry_offset(
+  void *context,
+  size_t ops,
+  uint64_t *elapsed_ns)
+{
+  struct aesd_circular_buffer buffer;
+  ssize_t fpos;
+  size_t sum = 0;
+  uint64_t start;
+
+  bench_circular_buffer_fill(&buffer);
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    fpos = aesd_circular_buffer_find_fpos_for_entry_offset(
+      &buffer,
+      (i * UINT64_C(2654435761)) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED,
+      0);
+    if (fpos < 0)
+      return false;
+    sum += fpos;
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+
+  return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench_options_t options;
+  long capacity = AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+
+  if (!bench_parse_options(&options, argc, argv))
+    return EXIT_FAILURE;
+
+  if (
+    !bench_run(
+      &options,
+      "circular_buffer/add_entry",
+      capacity,
+      bench_add_entry,
+      NULL,
+      CIRCULAR_BUFFER_OPS) ||
+    !bench_run(
+      &options,
+      "circular_buffer/find_entry_offset_for_fpos",
+      capacity,
+      bench_find_entry_offset_for_fpos,
+      NULL,
+      CIRCULAR_BUFFER_OPS) ||
+    !bench_run(
+      &options,
+      "circular_buffer/find_fpos_for_entry_offset",
+      capacity,
+      bench_find_fpos_for_entry_offset,
+      NULL,
+      CIRCULAR_BUFFER_OPS))
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file concurrent_queue_bench.c
+ * @brief Throughput of concurrent_queue_t across producer/consumer counts
+ *
+ * For 1, 2 and 4 producers and consumers, moves the same number of tids
+ * through the queue with the blocking operations, once sleeping on a futex
+ * and once on a condition variable. Each benchmark is named after the wait
+ * and the producer count, its param is the consumer count, and its time is
+ * per tid. Threads are pinned to consecutive CPUs from the one given with -c.
+ * Run with -h for the options of bench.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "concurrent_queue.h"
+
+#define CONCURRENT_QUEUE_OPS 200000
+#define MAX_THREADS 4
+
+struct concurrent_queue_bench
+{
+  bool use_futex;
+  unsigned producers;
+  unsigned consumers;
+  int cpu;
+};
+
+struct concurrent_queue_worker
+{
+  struct concurrent_queue_bench *bench;
+  concurrent_queue_t *queue;
+  pthread_mutex_t *start;
+  /* Consumers first, then producers */
+  unsigned index;
+  /* To produce, or consumed */
+  size_t items;
+};
+
+static void
+bench_worker_start(struct concurrent_queue_worker *worker)
+{
+  if (worker->bench->cpu >= 0)
+    bench_pin_thread(worker->bench->cpu + worker->index);
+  pthread_mutex_lock(worker->start);
+  pthread_mutex_unlock(worker->start);
+}
+
+static void *
+bench_producer(void *arg)
+{
+  struct concurrent_queue_worker *worker = arg;
+
+  bench_worker_start(worker);
+  for (size_t i = 0; i < worker->items; ++i) {
+    if (!concurrent_queue_enqueue(worker->queue, (pthread_t)i + 1))
+      break;
+  }
+
+  return NULL;
+}
+
+static void *
+bench_consumer(void *arg)
+{
+  struct concurrent_queue_worker *worker = arg;
+  pthread_t tid;
+
+  bench_worker_start(worker);
+  while (concurrent_queue_dequeue(worker->queue, &tid))
+    ++worker->items;
+
+  return NULL;
+}
+
+/*
+ * Times from the release of every thread, held on start until all of them are
+ * created, until the consumers drained the closed queue.
+ */
+static bool
+bench_concurrent_queue(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct concurrent_queue_bench *bench = context;
+  struct concurrent_queue_worker workers[2 * MAX_THREADS];
+  pthread_t threads[2 * MAX_THREADS];
+  pthread_mutex_t start = PTHREAD_MUTEX_INITIALIZER;
+  concurrent_queue_t *queue;
+  unsigned threads_count = bench->consumers + bench->producers;
+  unsigned started = 0;
+  size_t items_per_producer = ops / bench->producers;
+  size_t consumed = 0;
+  uint64_t start_ns;
+
+  if (!(queue = concurrent_queue_new(bench->use_futex)))
+    return false;
+
+  pthread_mutex_lock(&start);
+
+  for (; started < threads_count; ++started) {
+    workers[started] = (struct concurrent_queue_worker){
+      .bench = bench,
+      .queue = queue,
+      .start = &start,
+      .index = started,
+      .items = started < bench->consumers ? 0 : items_per_producer,
+    };
+    if (pthread_create(
+          &threads[started],
+          NULL,
+          started < bench->consumers ? bench_consumer : bench_producer,
+          &workers[started]))
+      break;
+  }
+
+  start_ns = bench_now_ns();
+  pthread_mutex_unlock(&start);
+  for (unsigned i = bench->consumers; i < started; ++i)
+    pthread_join(threads[i], NULL);
+  concurrent_queue_close(queue);
+  for (unsigned i = 0; i < started && i < bench->consumers; ++i) {
+    pthread_join(threads[i], NULL);
+    consumed += workers[i].items;
+  }
+  *elapsed_ns = bench_now_ns() - start_ns;
+
+  pthread_mutex_destroy(&start);
+  concurrent_queue_destroy(queue);
+
+  return started == threads_count &&
+         consumed == items_per_producer * bench->producers;
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench_options_t options;
+  struct concurrent_queue_bench bench;
+  char name[64];
+
+  if (!bench_parse_options(&options, argc, argv))
+    return EXIT_FAILURE;
+  bench.cpu = options.cpu;
+
+  for (int use_futex = 1; use_futex >= 0; --use_futex) {
+    bench.use_futex = use_futex;
+
+    for (bench.producers = 1; bench.producers <= MAX_THREADS;
+         bench.producers *= 2) {
+      snprintf(
+        name,
+        sizeof(name),
+        "concurrent_queue/%s/%u_producers",
+        use_futex ? "futex" : "condvar",
+        bench.producers);
+
+      for (bench.consumers = 1; bench.consumers <= MAX_THREADS;
+           bench.consumers *= 2) {
+        if (!bench_run(
+              &options,
+              name,
+              bench.consumers,
+              bench_concurrent_queue,
+              &bench,
+              CONCURRENT_QUEUE_OPS))
+          return EXIT_FAILURE;
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,518 @@
+/**
+ * @file microbench.c
+ * @brief Microbenchmarks of the containers and of monitor_t
+ *
+ * queue_t and doubly_linked_list_t are timed holding 10^2 to 10^4 tids:
+ * enqueue and dequeue pairs, which keep their size, reads of random positions
+ * and, for the list, insertions and removals at random positions. monitor_t
+ * is timed for each policy with 1 to MAX_THREADS threads taking it for
+ * reading only, for writing only, and for reading with one write in ten.
+ * timestamp_formatter_t is compared with strftime for timestamps which
+ * advance by 0, 1 and 60 seconds per call.
+ * Run with -h for the options of bench.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+#include "doubly_linked_list.h"
+#include "monitor.h"
+#include "node_pool.h"
+#include "queue.h"
+#include "timestamp_formatter.h"
+
+#define MIN_ELEMENTS 100
+#define MAX_ELEMENTS 10000
+#define CONTAINER_OPS 100000
+/* The list walks up to half of its nodes for each indexed operation */
+#define INDEXED_LIST_OPS 2000
+#define MAX_THREADS 8
+#define MONITOR_OPS 20000
+#define TIMESTAMP_OPS 100000
+/* The timestamp of aesdsocket */
+#define TIMESTAMP_FORMAT "timestamp:%a, %d %b %Y %T %z"
+/* 2024-03-31 00:00 UTC */
+#define TIMESTAMP_START 1711843200
+
+struct container_bench
+{
+  size_t elements;
+};
+
+struct monitor_bench
+{
+  monitor_policy_t policy;
+  /* Out of every 100 acquisitions */
+  unsigned write_percent;
+  unsigned threads;
+  int cpu;
+};
+
+struct monitor_worker
+{
+  struct monitor_bench *bench;
+  monitor_t *monitor;
+  pthread_mutex_t *start;
+  unsigned index;
+  size_t ops;
+  uint64_t *shared;
+};
+
+struct timestamp_bench
+{
+  /* Seconds between consecutive timestamps */
+  time_t step;
+};
+
+static const char *const monitor_policy_names[] = {
+  [MONITOR_PREFER_READERS] = "prefer_readers",
+  [MONITOR_PREFER_WRITERS] = "prefer_writers",
+  [MONITOR_PHASE_FAIR] = "phase_fair",
+};
+
+/* Spreads i over [0, elements) with a multiplicative hash. */
+static size_t
+bench_position(size_t i, size_t elements)
+{
+  return (size_t)((i * UINT64_C(2654435761)) % elements);
+}
+
+static queue_t *
+bench_queue_fill(size_t elements)
+{
+  queue_t *queue = queue_new();
+
+  for (size_t i = 0; queue && i < elements; ++i) {
+    if (!queue_enqueue(queue, i + 1)) {
+      queue_destroy(queue);
+      return NULL;
+    }
+  }
+
+  return queue;
+}
+
+static void
+bench_queue_destroy(queue_t *queue)
+{
+  while (!queue_is_empty(queue))
+    queue_dequeue(queue);
+  queue_destroy(queue);
+}
+
+static doubly_linked_list_t *
+bench_list_fill(size_t elements)
+{
+  doubly_linked_list_t *list = doubly_linked_list_new();
+
+  for (size_t i = 0; list && i < elements; ++i) {
+    if (!doubly_linked_list_insert_tail(list, i + 1)) {
+      doubly_linked_list_destroy(list);
+      return NULL;
+    }
+  }
+
+  return list;
+}
+
+static void
+bench_list_destroy(doubly_linked_list_t *list)
+{
+  while (!doubly_linked_list_is_empty(list))
+    doubly_linked_list_remove_tail(list);
+  doubly_linked_list_destroy(list);
+}
+
+static bool
+bench_queue_enqueue_dequeue(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  queue_t *queue = bench_queue_fill(bench->elements);
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!queue)
+    return false;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    queue_enqueue(queue, i);
+    sum += queue_dequeue(queue);
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  bench_queue_destroy(queue);
+
+  return true;
+}
+
+static bool
+bench_queue_get(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  queue_t *queue = bench_queue_fill(bench->elements);
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!queue)
+    return false;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i)
+    sum += queue_get(queue, bench_position(i, bench->elements));
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  bench_queue_destroy(queue);
+
+  return true;
+}
+
+static bool
+bench_list_insert_remove_ends(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  doubly_linked_list_t *list = bench_list_fill(bench->elements);
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!list)
+    return false;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    doubly_linked_list_insert_tail(list, i);
+    sum += doubly_linked_list_remove_head(list);
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  bench_list_destroy(list);
+
+  return true;
+}
+
+static bool
+bench_list_get(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  doubly_linked_list_t *list = bench_list_fill(bench->elements);
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!list)
+    return false;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i)
+    sum += doubly_linked_list_get(list, bench_position(i, bench->elements));
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  bench_list_destroy(list);
+
+  return true;
+}
+
+/* An operation is an insertion followed by a removal, both at random. */
+static bool
+bench_list_insert_remove(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  doubly_linked_list_t *list = bench_list_fill(bench->elements);
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!list)
+    return false;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    doubly_linked_list_insert(
+      list,
+      bench_position(i, bench->elements + 1),
+      i);
+    sum += doubly_linked_list_remove(
+      list,
+      bench_position(i + ops, bench->elements + 1));
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  bench_list_destroy(list);
+
+  return true;
+}
+
+static void *
+bench_monitor_worker(void *arg)
+{
+  struct monitor_worker *worker = arg;
+  uint64_t sum = 0;
+
+  if (worker->bench->cpu >= 0)
+    bench_pin_thread(worker->bench->cpu + worker->index);
+  pthread_mutex_lock(worker->start);
+  pthread_mutex_unlock(worker->start);
+
+  for (size_t i = 0; i < worker->ops; ++i) {
+    if ((i + worker->index) % 100 < worker->bench->write_percent) {
+      monitor_start_writing(worker->monitor);
+      ++*worker->shared;
+      monitor_stop_writing(worker->monitor);
+    } else {
+      monitor_start_reading(worker->monitor);
+      sum += *worker->shared;
+      monitor_stop_reading(worker->monitor);
+    }
+  }
+
+  bench_sink += sum;
+
+  return NULL;
+}
+
+/*
+ * Times from the release of every thread, held on start until all of them are
+ * created, until the last one is done.
+ */
+static bool
+bench_monitor(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct monitor_bench *bench = context;
+  struct monitor_worker workers[MAX_THREADS];
+  pthread_t threads[MAX_THREADS];
+  pthread_mutex_t start = PTHREAD_MUTEX_INITIALIZER;
+  monitor_t monitor;
+  uint64_t shared = 0;
+  uint64_t start_ns;
+  unsigned started = 0;
+
+  monitor_initialize(&monitor, bench->policy);
+  pthread_mutex_lock(&start);
+
+  for (; started < bench->threads; ++started) {
+    workers[started] = (struct monitor_worker){
+      .bench = bench,
+      .monitor = &monitor,
+      .start = &start,
+      .index = started,
+      .ops = ops / bench->threads,
+      .shared = &shared,
+    };
+    if (pthread_create(
+          &threads[started],
+          NULL,
+          bench_monitor_worker,
+          &workers[started]))
+      break;
+  }
+
+  start_ns = bench_now_ns();
+  pthread_mutex_unlock(&start);
+  for (unsigned i = 0; i < started; ++i)
+    pthread_join(threads[i], NULL);
+  *elapsed_ns = bench_now_ns() - start_ns;
+
+  pthread_mutex_destroy(&start);
+  monitor_finalize(&monitor);
+
+  return started == bench->threads;
+}
+
+static bool
+bench_strftime(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct timestamp_bench *bench = context;
+  char text[TIMESTAMP_FORMATTER_SIZE];
+  size_t sum = 0;
+  struct tm local;
+  time_t seconds;
+  uint64_t start;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    seconds = TIMESTAMP_START + i * bench->step;
+    localtime_r(&seconds, &local);
+    sum += strftime(text, sizeof(text), TIMESTAMP_FORMAT, &local);
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+
+  return true;
+}
+
+static bool
+bench_timestamp_formatter(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct timestamp_bench *bench = context;
+  timestamp_formatter_t formatter;
+  size_t sum = 0;
+  size_t length;
+  uint64_t start;
+
+  if (!timestamp_formatter_initialize(&formatter, TIMESTAMP_FORMAT))
+    return false;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    if (!timestamp_formatter_format(
+          &formatter,
+          TIMESTAMP_START + i * bench->step,
+          &length))
+      break;
+    sum += length;
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  timestamp_formatter_finalize(&formatter);
+
+  return sum > 0;
+}
+
+static bool
+bench_containers(const bench_options_t *options)
+{
+  struct container_bench bench;
+
+  for (size_t elements = MIN_ELEMENTS; elements <= MAX_ELEMENTS;
+       elements *= 10) {
+    bench.elements = elements;
+
+    if (
+      !bench_run(
+        options,
+        "queue/enqueue_dequeue",
+        elements,
+        bench_queue_enqueue_dequeue,
+        &bench,
+        CONTAINER_OPS) ||
+      !bench_run(
+        options,
+        "queue/get",
+        elements,
+        bench_queue_get,
+        &bench,
+        CONTAINER_OPS) ||
+      !bench_run(
+        options,
+        "list/insert_tail_remove_head",
+        elements,
+        bench_list_insert_remove_ends,
+        &bench,
+        CONTAINER_OPS) ||
+      !bench_run(
+        options,
+        "list/get",
+        elements,
+        bench_list_get,
+        &bench,
+        INDEXED_LIST_OPS) ||
+      !bench_run(
+        options,
+        "list/insert_remove",
+        elements,
+        bench_list_insert_remove,
+        &bench,
+        INDEXED_LIST_OPS))
+      return false;
+  }
+
+  return true;
+}
+
+static bool
+bench_monitors(const bench_options_t *options)
+{
+  static const struct
+  {
+    const char *name;
+    unsigned write_percent;
+  } mixes[] = { { "read", 0 }, { "write", 100 }, { "read_write_10", 10 } };
+  struct monitor_bench bench = { .cpu = options->cpu };
+  char name[64];
+
+  for (int policy = 0; policy < 3; ++policy) {
+    bench.policy = policy;
+
+    for (size_t mix = 0; mix < sizeof(mixes) / sizeof(mixes[0]); ++mix) {
+      bench.write_percent = mixes[mix].write_percent;
+      snprintf(
+        name,
+        sizeof(name),
+        "monitor/%s/%s",
+        monitor_policy_names[policy],
+        mixes[mix].name);
+
+      for (bench.threads = 1; bench.threads <= MAX_THREADS;
+           bench.threads *= 2) {
+        if (!bench_run(
+              options,
+              name,
+              bench.threads,
+              bench_monitor,
+              &bench,
+              MONITOR_OPS))
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static bool
+bench_timestamps(const bench_options_t *options)
+{
+  static const time_t steps[] = { 0, 1, 60 };
+  struct timestamp_bench bench;
+
+  for (size_t step = 0; step < sizeof(steps) / sizeof(steps[0]); ++step) {
+    bench.step = steps[step];
+
+    if (
+      !bench_run(
+        options,
+        "timestamp/strftime",
+        bench.step,
+        bench_strftime,
+        &bench,
+        TIMESTAMP_OPS) ||
+      !bench_run(
+        options,
+        "timestamp/formatter",
+        bench.step,
+        bench_timestamp_formatter,
+        &bench,
+        TIMESTAMP_OPS))
+      return false;
+  }
+
+  return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench_options_t options;
+  bool ok;
+
+  if (!bench_parse_options(&options, argc, argv))
+    return EXIT_FAILURE;
+
+  ok = bench_containers(&options) && bench_monitors(&options) &&
+       bench_timestamps(&options);
+  node_pool_finalize();
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,312 @@
+/**
+ * @file queue_bench.c
+ * @brief Compares the ring backed queue_t with doubly_linked_list_t
+ *
+ * For 10^3 to 10^6 tids, given as param, times filling and draining each
+ * container in FIFO order, one operation per tid, and reading random
+ * positions, then prints the statistics of the node pool backing the list
+ * unless the output is JSON. Run with -h for the options of bench.h; -s also
+ * scales the number of tids filled and drained.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "doubly_linked_list.h"
+#include "node_pool.h"
+#include "queue.h"
+
+#define MIN_ELEMENTS 1000
+#define MAX_ELEMENTS 1000000
+/* The list walks up to half of its nodes for each one */
+#define RANDOM_GETS 1000
+
+struct container_bench
+{
+  size_t elements;
+  /* RANDOM_GETS positions in [0, elements) */
+  const size_t *positions;
+};
+
+static void
+bench_queue_destroy(queue_t *queue)
+{
+  while (!queue_is_empty(queue))
+    queue_dequeue(queue);
+  queue_destroy(queue);
+}
+
+static void
+bench_list_destroy(doubly_linked_list_t *list)
+{
+  while (!doubly_linked_list_is_empty(list))
+    doubly_linked_list_remove_tail(list);
+  doubly_linked_list_destroy(list);
+}
+
+static bool
+bench_queue_fill(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  bool ok = false;
+  queue_t *queue = NULL;
+  uint64_t start;
+
+  if (!(queue = queue_new()))
+    goto done;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    if (!queue_enqueue(queue, i + 1))
+      goto done;
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  ok = true;
+
+done:
+  if (queue)
+    bench_queue_destroy(queue);
+
+  return ok;
+}
+
+static bool
+bench_queue_drain(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  bool ok = false;
+  queue_t *queue = NULL;
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!(queue = queue_new()))
+    goto done;
+
+  for (size_t i = 0; i < ops; ++i) {
+    if (!queue_enqueue(queue, i + 1))
+      goto done;
+  }
+
+  start = bench_now_ns();
+  while (!queue_is_empty(queue))
+    sum += queue_dequeue(queue);
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  ok = sum != 0;
+
+done:
+  if (queue)
+    bench_queue_destroy(queue);
+
+  return ok;
+}
+
+static bool
+bench_queue_random_get(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  bool ok = false;
+  queue_t *queue = NULL;
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!(queue = queue_new()))
+    goto done;
+
+  for (size_t i = 0; i < bench->elements; ++i) {
+    if (!queue_enqueue(queue, i + 1))
+      goto done;
+  }
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i)
+    sum += queue_get(queue, bench->positions[i % RANDOM_GETS]);
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  ok = sum != 0;
+
+done:
+  if (queue)
+    bench_queue_destroy(queue);
+
+  return ok;
+}
+
+static bool
+bench_list_fill(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  bool ok = false;
+  doubly_linked_list_t *list = NULL;
+  uint64_t start;
+
+  if (!(list = doubly_linked_list_new()))
+    goto done;
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i) {
+    if (!doubly_linked_list_insert_head(list, i + 1))
+      goto done;
+  }
+  *elapsed_ns = bench_now_ns() - start;
+
+  ok = true;
+
+done:
+  if (list)
+    bench_list_destroy(list);
+
+  return ok;
+}
+
+static bool
+bench_list_drain(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  bool ok = false;
+  doubly_linked_list_t *list = NULL;
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!(list = doubly_linked_list_new()))
+    goto done;
+
+  for (size_t i = 0; i < ops; ++i) {
+    if (!doubly_linked_list_insert_head(list, i + 1))
+      goto done;
+  }
+
+  start = bench_now_ns();
+  while (!doubly_linked_list_is_empty(list))
+    sum += doubly_linked_list_remove_tail(list);
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  ok = sum != 0;
+
+done:
+  if (list)
+    bench_list_destroy(list);
+
+  return ok;
+}
+
+static bool
+bench_list_random_get(void *context, size_t ops, uint64_t *elapsed_ns)
+{
+  struct container_bench *bench = context;
+  bool ok = false;
+  doubly_linked_list_t *list = NULL;
+  pthread_t sum = 0;
+  uint64_t start;
+
+  if (!(list = doubly_linked_list_new()))
+    goto done;
+
+  for (size_t i = 0; i < bench->elements; ++i) {
+    if (!doubly_linked_list_insert_head(list, i + 1))
+      goto done;
+  }
+
+  /* Inserted at the head, so that the positions match those of the queue */
+  start = bench_now_ns();
+  for (size_t i = 0; i < ops; ++i)
+    sum += doubly_linked_list_get(
+      list,
+      bench->elements - 1 - bench->positions[i % RANDOM_GETS]);
+  *elapsed_ns = bench_now_ns() - start;
+
+  bench_sink += sum;
+  ok = sum != 0;
+
+done:
+  if (list)
+    bench_list_destroy(list);
+
+  return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+  bench_options_t options;
+  size_t positions[RANDOM_GETS];
+  struct container_bench bench = { .positions = positions };
+  node_pool_stats_t stats;
+  bool ok = true;
+
+  if (!bench_parse_options(&options, argc, argv))
+    return EXIT_FAILURE;
+
+  srand(1);
+  for (size_t elements = MIN_ELEMENTS; ok && elements <= MAX_ELEMENTS;
+       elements *= 10) {
+    bench.elements = elements;
+    for (size_t i = 0; i < RANDOM_GETS; ++i)
+      positions[i] = rand() % elements;
+
+    ok =
+      bench_run(
+        &options,
+        "queue/fill",
+        elements,
+        bench_queue_fill,
+        &bench,
+        elements) &&
+      bench_run(
+        &options,
+        "queue/random_get",
+        elements,
+        bench_queue_random_get,
+        &bench,
+        RANDOM_GETS) &&
+      bench_run(
+        &options,
+        "queue/drain",
+        elements,
+        bench_queue_drain,
+        &bench,
+        elements) &&
+      bench_run(
+        &options,
+        "list/fill",
+        elements,
+        bench_list_fill,
+        &bench,
+        elements) &&
+      bench_run(
+        &options,
+        "list/random_get",
+        elements,
+        bench_list_random_get,
+        &bench,
+        RANDOM_GETS) &&
+      bench_run(
+        &options,
+        "list/drain",
+        elements,
+        bench_list_drain,
+        &bench,
+        elements);
+  }
+
+  if (ok && !options.json) {
+    node_pool_get_stats(&stats);
+    printf(
+      "node pool: %zu slabs, %zu allocations, %zu releases, %zu refills, "
+      "%zu flushes\n",
+      stats.slabs,
+      stats.allocations,
+      stats.releases,
+      stats.refills,
+      stats.flushes);
+  }
+  node_pool_finalize();
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
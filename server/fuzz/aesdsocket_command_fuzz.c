@@ -0,0 +1,335 @@
+/**
+ * @file aesdsocket_command_fuzz.c
+ * @brief Differential fuzzer of the aesdsocket command parser
+ *
+ * Every input is parsed by aesdsocket_command_parse and by a plain model built
+ * on a NUL terminated copy, strtoull and the specification of the commands,
+ * and both must agree on whether the input is a record, a valid command or a
+ * malformed one, and on the arguments. The input is handed to the parser in
+ * a buffer of exactly its size so that the sanitizers catch any read past it.
+ *
+ * Built with -DAESDSOCKET_LIBFUZZER and -fsanitize=fuzzer this is a libFuzzer
+ * target. Otherwise main either replays the files given as arguments or runs
+ * random inputs, commands with a few random edits so that most get past the
+ * name: aesdsocket_command_fuzz [-s seed] [-n iterations] [file...]
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aesdsocket_command.h"
+
+#define FUZZ_MAX_INPUT 256
+#define FUZZ_MAX_NUMBER_DIGITS 21
+
+#define FUZZ_CHECK(condition)                                                  \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(                                                                 \
+        stderr,                                                                \
+        "%s:%d: check failed: %s\n",                                           \
+        __FILE__,                                                              \
+        __LINE__,                                                              \
+        #condition);                                                           \
+      abort();                                                                 \
+    }                                                                          \
+  } while (0)
+
+/* READ_LAST and READ_SINCE share a prefix on purpose */
+static const char *const fuzz_names[AESDSOCKET_COMMAND_COUNT] = {
+  [AESDSOCKET_COMMAND_SEEKTO] = "AESDCHAR_IOCSEEKTO",
+  [AESDSOCKET_COMMAND_READ_BYTES] = "AESDSOCKET_READBYTES",
+  [AESDSOCKET_COMMAND_READ_LAST] = "AESDSOCKET_READ",
+  [AESDSOCKET_COMMAND_READ_SINCE] = "AESDSOCKET_READSINCE",
+};
+
+static const unsigned fuzz_argument_counts[AESDSOCKET_COMMAND_COUNT] = {
+  [AESDSOCKET_COMMAND_SEEKTO] = 2,
+  [AESDSOCKET_COMMAND_READ_BYTES] = 2,
+  [AESDSOCKET_COMMAND_READ_LAST] = 1,
+  [AESDSOCKET_COMMAND_READ_SINCE] = 1,
+};
+
+static const uint64_t fuzz_maximums[AESDSOCKET_COMMAND_COUNT] = {
+  [AESDSOCKET_COMMAND_SEEKTO] = UINT32_MAX,
+  [AESDSOCKET_COMMAND_READ_BYTES] = INT64_MAX,
+  [AESDSOCKET_COMMAND_READ_LAST] = INT64_MAX,
+  [AESDSOCKET_COMMAND_READ_SINCE] = INT64_MAX,
+};
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/* Parses one argument of the model, the whole of field. */
+static bool
+fuzz_model_number(const char *field, uint64_t maximum, uint64_t *value)
+{
+  unsigned long long number;
+  char *end;
+
+  if (!*field || strspn(field, "0123456789") != strlen(field))
+    return false;
+
+  errno = 0;
+  number = strtoull(field, &end, 10);
+  if (errno == ERANGE || number > maximum)
+    return false;
+
+  *value = number;
+
+  return true;
+}
+
+/*
+ * The model: returns -1 for a malformed command, 0 for a record and 1 for a
+ * valid command.
+ */
+static int
+fuzz_model(const char *data, size_t size, aesdsocket_command_t *command)
+{
+  char copy[FUZZ_MAX_INPUT + 1];
+  size_t name_length = 0;
+  char *arguments;
+  char *field;
+  char *save;
+  unsigned count = 0;
+
+  memset(command, 0, sizeof(aesdsocket_command_t));
+  for (int i = 0; i < AESDSOCKET_COMMAND_COUNT; ++i) {
+    if (
+      fuzz_names[i] && strlen(fuzz_names[i]) > name_length &&
+      size >= strlen(fuzz_names[i]) &&
+      strncmp(data, fuzz_names[i], strlen(fuzz_names[i])) == 0) {
+      command->type = i;
+      name_length = strlen(fuzz_names[i]);
+    }
+  }
+  if (command->type == AESDSOCKET_COMMAND_NONE)
+    return 0;
+
+  /* A NUL in a command is malformed whatever it replaces */
+  if (memchr(data, '\0', size))
+    return -1;
+  memcpy(copy, data, size);
+  copy[size] = '\0';
+
+  if (copy[name_length] != ':' || copy[size - 1] != '\n')
+    return -1;
+  copy[size - 1] = '\0';
+  arguments = copy + name_length + 1;
+  if (strchr(arguments, '\n'))
+    return -1;
+
+  /* strtok_r would merge empty fields */
+  for (field = arguments; field; field = save) {
+    save = strchr(field, ',');
+    if (save)
+      *save++ = '\0';
+    if (
+      count == fuzz_argument_counts[command->type] ||
+      !fuzz_model_number(
+        field,
+        fuzz_maximums[command->type],
+        &command->arguments[count]))
+      return -1;
+    ++count;
+  }
+
+  return count == fuzz_argument_counts[command->type] ? 1 : -1;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  char *input;
+  aesdsocket_command_t command;
+  aesdsocket_command_t expected;
+  const char *error = NULL;
+  bool parsed;
+  int model;
+
+  if (size > FUZZ_MAX_INPUT)
+    return 0;
+
+  /* Exactly size bytes, so that reading past them is caught */
+  input = malloc(size ? size : 1);
+  FUZZ_CHECK(input);
+  memcpy(input, data, size);
+
+  parsed = aesdsocket_command_parse(fuzz_names, input, size, &command, &error);
+  model = fuzz_model(input, size, &expected);
+
+  if (!parsed) {
+    FUZZ_CHECK(model == -1);
+    FUZZ_CHECK(error && *error);
+  } else {
+    FUZZ_CHECK(model >= 0);
+    FUZZ_CHECK(command.type == expected.type);
+    FUZZ_CHECK(
+      memcmp(command.arguments, expected.arguments, sizeof(expected.arguments))
+      == 0);
+  }
+
+  free(input);
+
+  return 0;
+}
+
+#ifndef AESDSOCKET_LIBFUZZER
+
+static int
+fuzz_replay(const char *path)
+{
+  FILE *stream = fopen(path, "rb");
+  uint8_t data[FUZZ_MAX_INPUT];
+  size_t size;
+
+  if (!stream) {
+    perror(path);
+    return -1;
+  }
+
+  size = fread(data, 1, sizeof(data), stream);
+  if (ferror(stream)) {
+    perror(path);
+    fclose(stream);
+    return -1;
+  }
+
+  fclose(stream);
+  LLVMFuzzerTestOneInput(data, size);
+
+  return 0;
+}
+
+/* Appends a random number, valid or not, to data. */
+static size_t
+fuzz_append_number(uint8_t *data, size_t size)
+{
+  static const char *const numbers[] = {
+    "0",
+    "4294967295",
+    "4294967296",
+    "9223372036854775807",
+    "9223372036854775808",
+    "18446744073709551616",
+    "-1",
+    "+1",
+    "",
+  };
+  const char *number;
+  size_t length;
+
+  if (rand() % 2) {
+    number = numbers[rand() % (sizeof(numbers) / sizeof(numbers[0]))];
+    length = strlen(number);
+    memcpy(data + size, number, length);
+  } else {
+    length = rand() % FUZZ_MAX_NUMBER_DIGITS + 1;
+    for (size_t i = 0; i < length; ++i)
+      data[size + i] = '0' + rand() % 10;
+  }
+
+  return size + length;
+}
+
+/*
+ * Writes a command with 0 to 3 arguments, mostly the right count, then
+ * inserts, deletes or replaces a few random bytes, NUL included, mostly after
+ * the name.
+ */
+static size_t
+fuzz_generate(uint8_t *data)
+{
+  static const char separators[] = ":,\n ";
+  int type = AESDSOCKET_COMMAND_NONE + 1 +
+             rand() % (AESDSOCKET_COMMAND_COUNT - AESDSOCKET_COMMAND_NONE - 1);
+  size_t name_length = strlen(fuzz_names[type]);
+  size_t size = name_length;
+  unsigned arguments = rand() % 2 ? fuzz_argument_counts[type] : rand() % 4;
+  unsigned mutations = rand() % 4;
+  size_t position;
+
+  memcpy(data, fuzz_names[type], size);
+  data[size++] = ':';
+  for (unsigned i = 0; i < arguments; ++i) {
+    if (i > 0)
+      data[size++] = ',';
+    size = fuzz_append_number(data, size);
+  }
+  data[size++] = '\n';
+
+  for (unsigned i = 0; i < mutations && size; ++i) {
+    if (size > name_length && rand() % 4)
+      position = name_length + rand() % (size - name_length);
+    else
+      position = rand() % size;
+    switch (rand() % 3) {
+      case 0:
+        memmove(data + position + 1, data + position, size - position);
+        data[position] = rand() % 2 ? separators[rand() % 4] : rand();
+        ++size;
+        break;
+      case 1:
+        memmove(data + position, data + position + 1, size - position - 1);
+        --size;
+        break;
+      default:
+        data[position] = rand() % 2 ? separators[rand() % 4] : rand();
+    }
+  }
+
+  return size;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned seed = 1;
+  unsigned long iterations = 100000;
+  uint8_t data[FUZZ_MAX_INPUT];
+  size_t size;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:n:")) != -1) {
+    switch (option) {
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(
+          stderr,
+          "usage: %s [-s seed] [-n iterations] [file...]\n",
+          argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    for (int i = optind; i < argc; ++i) {
+      if (fuzz_replay(argv[i]) < 0)
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  srand(seed);
+  for (unsigned long i = 0; i < iterations; ++i) {
+    size = fuzz_generate(data);
+    LLVMFuzzerTestOneInput(data, size);
+  }
+
+  printf("%lu inputs passed\n", iterations);
+
+  return EXIT_SUCCESS;
+}
+
+#endif /* AESDSOCKET_LIBFUZZER */
@@ -4,15 +4,21 @@
 #include <stdbool.h>
 #include <time.h>
 
+#include "aesdsocket_command.h"
+#include "monitor.h"
+
 bool aesdsocket_mainloop(
   const char *port,
   int backlog,
   const char *filename,
   bool is_regular_file,
+  const char *index_filename,
   bool daemon,
   bool use_timestamp,
   time_t timestamp_frequency_seconds,
   const char *timestamp_format,
-  const char *seekto_command);
+  const char *const command_names[AESDSOCKET_COMMAND_COUNT],
+  monitor_policy_t file_monitor_policy,
+  bool stamp_records);
 
 #endif /* AESDSOCKET_H */
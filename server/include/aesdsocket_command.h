@@ -0,0 +1,51 @@
+#ifndef AESDSOCKET_COMMAND_H
+#define AESDSOCKET_COMMAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AESDSOCKET_COMMAND_MAX_ARGUMENTS 2
+
+/*
+ * Commands of the aesdsocket protocol, all of the form
+ * "<name>:<argument>,...,<argument>\n" where every argument is a decimal
+ * number, bounded by the command. Names are given by the caller, indexed by
+ * type, so that they stay configurable. A line is a command when it starts
+ * with a name; anything else is a record to append. Adding a command takes a
+ * type and an entry in the table of aesdsocket_command.c.
+ *
+ * Records are numbered from 0 in the order they were appended, and keep their
+ * number when the device evicts the oldest ones.
+ */
+enum aesdsocket_command_type
+{
+  /* Not a command */
+  AESDSOCKET_COMMAND_NONE,
+  /* write_cmd, write_cmd_offset of struct aesd_seekto */
+  AESDSOCKET_COMMAND_SEEKTO,
+  /* offset, length: the bytes in [offset, offset + length) */
+  AESDSOCKET_COMMAND_READ_BYTES,
+  /* count: the last count records */
+  AESDSOCKET_COMMAND_READ_LAST,
+  /* record: the records from this number on */
+  AESDSOCKET_COMMAND_READ_SINCE,
+  AESDSOCKET_COMMAND_COUNT,
+};
+typedef enum aesdsocket_command_type aesdsocket_command_type_t;
+
+struct aesdsocket_command
+{
+  aesdsocket_command_type_t type;
+  uint64_t arguments[AESDSOCKET_COMMAND_MAX_ARGUMENTS];
+};
+typedef struct aesdsocket_command aesdsocket_command_t;
+
+bool aesdsocket_command_parse(
+  const char *const names[AESDSOCKET_COMMAND_COUNT],
+  const char *data,
+  size_t size,
+  aesdsocket_command_t *command,
+  const char **error);
+
+#endif /* AESDSOCKET_COMMAND_H */
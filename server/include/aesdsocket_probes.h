@@ -0,0 +1,65 @@
+#ifndef AESDSOCKET_PROBES_H
+#define AESDSOCKET_PROBES_H
+
+/*
+ * USDT probes of the aesdsocket provider, at every stage of a request. With
+ * <sys/sdt.h> (systemtap-sdt-dev) each one is a nop and an ELF note that perf
+ * and bpftrace attach to; without it, or with -DAESDSOCKET_NO_PROBES
+ * (make NO_PROBES=1), they compile to nothing. A connection is served by a
+ * thread of its own, so the thread id ties the stages of a request together:
+ *
+ *   accept(fd)                       connection accepted, in the main thread
+ *   request__start(fd)               serving thread started
+ *   recv__done(fd, bytes)            request line received
+ *   seekto(fd, write_cmd, offset)    seekto command parsed
+ *   lock__wait(mode)                 about to take the file monitor
+ *   lock__acquired(mode)             file monitor taken
+ *   lock__released(mode)             file monitor released
+ *   append__done(bytes)              line appended to the file
+ *   file__read(bytes)                chunk read from the device
+ *   send__done(fd, bytes)            reply chunk sent back
+ *   request__done(fd, ok)            request over, connection closing
+ *
+ * mode is a monitor_profile_mode_t. For instance, the lock wait histogram:
+ *
+ *   bpftrace -e 'usdt:./aesdsocket:aesdsocket:lock__wait { @s[tid] = nsecs }
+ *     usdt:./aesdsocket:aesdsocket:lock__acquired /@s[tid]/ {
+ *       @wait_ns[arg0] = hist(nsecs - @s[tid]); delete(@s[tid]) }'
+ */
+
+#if !defined(AESDSOCKET_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define AESDSOCKET_PROBES
+#endif
+#endif
+
+#ifdef AESDSOCKET_PROBES
+
+#define AESDSOCKET_PROBE1(name, a) DTRACE_PROBE1(aesdsocket, name, a)
+#define AESDSOCKET_PROBE2(name, a, b) DTRACE_PROBE2(aesdsocket, name, a, b)
+#define AESDSOCKET_PROBE3(name, a, b, c)                                       \
+  DTRACE_PROBE3(aesdsocket, name, a, b, c)
+
+#else
+
+/* The arguments are not evaluated, only kept used */
+#define AESDSOCKET_PROBE1(name, a)                                             \
+  do {                                                                         \
+    (void)sizeof(a);                                                           \
+  } while (0)
+#define AESDSOCKET_PROBE2(name, a, b)                                          \
+  do {                                                                         \
+    (void)sizeof(a);                                                           \
+    (void)sizeof(b);                                                           \
+  } while (0)
+#define AESDSOCKET_PROBE3(name, a, b, c)                                       \
+  do {                                                                         \
+    (void)sizeof(a);                                                           \
+    (void)sizeof(b);                                                           \
+    (void)sizeof(c);                                                           \
+  } while (0)
+
+#endif /* AESDSOCKET_PROBES */
+
+#endif /* AESDSOCKET_PROBES_H */
@@ -0,0 +1,51 @@
+#ifndef CONCURRENT_QUEUE_H
+#define CONCURRENT_QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aesd-ring.h"
+
+/*
+ * Bounded queue of tids that any number of threads may use at once. The
+ * non-blocking operations are lock free; the blocking ones only sleep, on a
+ * futex or on a condition variable, when the ring is full or empty.
+ */
+
+#define CONCURRENT_QUEUE_CAPACITY 1024
+
+AESD_RING_DEFINE_MPMC(tid_mpmc_ring, pthread_t, CONCURRENT_QUEUE_CAPACITY)
+
+struct concurrent_queue
+{
+  struct tid_mpmc_ring ring;
+  /* Bumped after every dequeue and enqueue respectively, waited on as futex
+   * words or under lock */
+  uint32_t not_full __attribute__((aligned(AESD_RING_CACHELINE_SIZE)));
+  unsigned full_waiters;
+  uint32_t not_empty __attribute__((aligned(AESD_RING_CACHELINE_SIZE)));
+  unsigned empty_waiters;
+  bool closed;
+  bool use_futex;
+  pthread_mutex_t lock;
+  pthread_cond_t can_enqueue;
+  pthread_cond_t can_dequeue;
+};
+typedef struct concurrent_queue concurrent_queue_t;
+
+bool concurrent_queue_initialize(concurrent_queue_t *self, bool use_futex);
+void concurrent_queue_finalize(concurrent_queue_t *self);
+
+concurrent_queue_t *concurrent_queue_new(bool use_futex);
+void concurrent_queue_destroy(concurrent_queue_t *self);
+
+size_t concurrent_queue_size(const concurrent_queue_t *self);
+bool concurrent_queue_try_enqueue(concurrent_queue_t *self, pthread_t tid);
+bool concurrent_queue_try_dequeue(concurrent_queue_t *self, pthread_t *tid);
+bool concurrent_queue_enqueue(concurrent_queue_t *self, pthread_t tid);
+bool concurrent_queue_dequeue(concurrent_queue_t *self, pthread_t *tid);
+void concurrent_queue_close(concurrent_queue_t *self);
+
+#endif /* CONCURRENT_QUEUE_H */
@@ -1,17 +1,16 @@
 #ifndef DOUBLY_LINKED_LIST_H
 #define DOUBLY_LINKED_LIST_H
 
-#include <bits/pthreadtypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 
-#include "node.h"
+#include "list.h"
 
+/* list_t of tids, each in a node_t taken from the node pool. */
 struct doubly_linked_list
 {
-  node_t *head;
-  node_t *tail;
-  size_t size;
+  list_t nodes;
 };
 typedef struct doubly_linked_list doubly_linked_list_t;
 
@@ -0,0 +1,54 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Intrusive doubly linked list. The payload embeds a list_link_t and the list
+ * only chains those links, so it works for any type, never allocates, and a
+ * known element is unlinked in constant time. LIST_ENTRY turns a link back
+ * into the structure holding it.
+ */
+
+struct list_link
+{
+  struct list_link *next;
+  struct list_link *prev;
+};
+typedef struct list_link list_link_t;
+
+struct list
+{
+  list_link_t *head;
+  list_link_t *tail;
+  size_t size;
+};
+typedef struct list list_t;
+
+#define LIST_ENTRY(link, type, member)                                         \
+  ((type *)((char *)(link) - offsetof(type, member)))
+
+#define LIST_FOREACH(link, list)                                               \
+  for ((link) = (list)->head; (link); (link) = (link)->next)
+
+bool list_initialize(list_t *self);
+void list_finalize(list_t *self);
+
+size_t list_size(const list_t *self);
+bool list_is_empty(const list_t *self);
+
+list_link_t *list_get(const list_t *self, size_t pos);
+list_link_t *list_get_head(const list_t *self);
+list_link_t *list_get_tail(const list_t *self);
+
+void list_insert(list_t *self, size_t pos, list_link_t *link);
+void list_insert_head(list_t *self, list_link_t *link);
+void list_insert_tail(list_t *self, list_link_t *link);
+
+list_link_t *list_remove(list_t *self, size_t pos);
+list_link_t *list_remove_head(list_t *self);
+list_link_t *list_remove_tail(list_t *self);
+void list_unlink(list_t *self, list_link_t *link);
+
+#endif /* LIST_H */
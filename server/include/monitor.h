@@ -3,23 +3,70 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "list.h"
+
+/*
+ * Readers-writer lock. The policy decides who goes first when both readers
+ * and writers wait:
+ * - MONITOR_PREFER_READERS: writers wait until no reader is active or waiting.
+ * - MONITOR_PREFER_WRITERS: readers wait while a writer is active or waiting.
+ * - MONITOR_PHASE_FAIR: like MONITOR_PREFER_WRITERS, but when a writer leaves,
+ *   every reader that was waiting goes in before the next writer.
+ * Writers always go in FIFO order among themselves.
+ */
+enum monitor_policy
+{
+  MONITOR_PREFER_READERS,
+  MONITOR_PREFER_WRITERS,
+  MONITOR_PHASE_FAIR,
+};
+typedef enum monitor_policy monitor_policy_t;
+
+/* Times are in nanoseconds. Read hold time counts while any reader is in. */
+struct monitor_stats
+{
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t contended_reads;
+  uint64_t contended_writes;
+  uint64_t failed_acquisitions;
+  uint64_t read_wait_ns;
+  uint64_t write_wait_ns;
+  uint64_t max_wait_ns;
+  uint64_t read_hold_ns;
+  uint64_t write_hold_ns;
+  uint64_t max_write_hold_ns;
+  unsigned max_queue_depth;
+};
+typedef struct monitor_stats monitor_stats_t;
 
 struct monitor
 {
+  monitor_policy_t policy;
   unsigned active_readers;
   unsigned active_writers;
   unsigned waiting_readers;
-  unsigned waiting_writers;
+  /* Readers let in by the last writer that have not woken up yet */
+  unsigned admitted_readers;
+  /* Incremented whenever a writer leaves */
+  uint64_t phase;
+  /* Waiting writers, each with its own condition variable */
+  list_t waiting_writers;
+  uint64_t read_start_ns;
+  uint64_t write_start_ns;
+  monitor_stats_t stats;
   pthread_cond_t can_read;
-  pthread_cond_t can_write;
   pthread_mutex_t condition_lock;
 };
 typedef struct monitor monitor_t;
 
-bool monitor_initialize(monitor_t *self);
+bool monitor_initialize(monitor_t *self, monitor_policy_t policy);
 void monitor_finalize(monitor_t *self);
 
-monitor_t *monitor_new(void);
+monitor_t *monitor_new(monitor_policy_t policy);
 void monitor_destroy(monitor_t *self);
 
 void monitor_start_reading(monitor_t *self);
@@ -27,4 +74,18 @@ void monitor_stop_reading(monitor_t *self);
 void monitor_start_writing(monitor_t *self);
 void monitor_stop_writing(monitor_t *self);
 
+/* Return false instead of waiting. */
+bool monitor_try_start_reading(monitor_t *self);
+bool monitor_try_start_writing(monitor_t *self);
+
+/* deadline is on CLOCK_MONOTONIC. Return false once it has passed. */
+bool monitor_timed_start_reading(
+  monitor_t *self,
+  const struct timespec *deadline);
+bool monitor_timed_start_writing(
+  monitor_t *self,
+  const struct timespec *deadline);
+
+void monitor_get_stats(monitor_t *self, monitor_stats_t *stats);
+
 #endif /* MONITOR_H */
@@ -0,0 +1,62 @@
+#ifndef MONITOR_PROFILE_H
+#define MONITOR_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Contention profiling of monitor_t, compiled in with -DMONITOR_PROFILE
+ * (make MONITOR_PROFILE=1). Every thread records, for reads and writes, how
+ * long it waited to acquire a monitor and how long it held it, in log2
+ * histograms of its own. monitor_profile_dump logs them. Without
+ * MONITOR_PROFILE every call below compiles to nothing.
+ */
+
+enum monitor_profile_mode
+{
+  MONITOR_PROFILE_READ,
+  MONITOR_PROFILE_WRITE,
+  MONITOR_PROFILE_MODES,
+};
+typedef enum monitor_profile_mode monitor_profile_mode_t;
+
+#ifdef MONITOR_PROFILE
+
+uint64_t monitor_profile_now(void);
+void monitor_profile_acquired(monitor_profile_mode_t mode, uint64_t arrival);
+void monitor_profile_released(monitor_profile_mode_t mode);
+
+void monitor_profile_dump(void);
+void monitor_profile_finalize(void);
+
+#else
+
+static inline uint64_t
+monitor_profile_now(void)
+{
+  return 0;
+}
+
+static inline void
+monitor_profile_acquired(monitor_profile_mode_t mode, uint64_t arrival)
+{
+}
+
+static inline void
+monitor_profile_released(monitor_profile_mode_t mode)
+{
+}
+
+static inline void
+monitor_profile_dump(void)
+{
+}
+
+static inline void
+monitor_profile_finalize(void)
+{
+}
+
+#endif /* MONITOR_PROFILE */
+
+#endif /* MONITOR_PROFILE_H */
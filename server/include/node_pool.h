@@ -0,0 +1,40 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "node.h"
+
+/*
+ * Process wide free list allocator for node_t. Nodes are carved from slabs
+ * and never returned to malloc before node_pool_finalize. Each thread keeps a
+ * small cache, refilled from and flushed to the shared free list in batches,
+ * so that in steady state allocating or releasing a node takes no lock.
+ */
+
+#define NODE_POOL_SLAB_NODES 256
+#define NODE_POOL_BATCH_NODES 32
+
+struct node_pool_stats
+{
+  size_t slabs;
+  size_t allocations;
+  size_t releases;
+  /* Batches moved from the shared free list to a thread cache */
+  size_t refills;
+  /* Batches moved from a thread cache back to the shared free list */
+  size_t flushes;
+  size_t shared_free_nodes;
+};
+typedef struct node_pool_stats node_pool_stats_t;
+
+node_t *node_pool_allocate(void);
+void node_pool_release(node_t *node);
+
+void node_pool_flush_thread_cache(void);
+void node_pool_get_stats(node_pool_stats_t *stats);
+void node_pool_finalize(void);
+
+#endif /* NODE_POOL_H */
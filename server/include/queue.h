@@ -1,12 +1,22 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
-#include <bits/pthreadtypes.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 
-#include "doubly_linked_list.h"
+#include "aesd-ring.h"
 
-typedef doubly_linked_list_t queue_t;
+/*
+ * FIFO of tids. Queues of other payloads are specialised the same way with
+ * AESD_RING_DEFINE_GROWABLE.
+ */
+
+#define QUEUE_INITIAL_CAPACITY 16
+
+AESD_RING_DEFINE_GROWABLE(tid_ring, pthread_t, QUEUE_INITIAL_CAPACITY)
+
+typedef struct tid_ring queue_t;
 
 bool queue_initialize(queue_t *self);
 void queue_finalize(queue_t *self);
@@ -14,7 +24,9 @@ void queue_finalize(queue_t *self);
 queue_t *queue_new(void);
 void queue_destroy(queue_t *self);
 
+size_t queue_size(const queue_t *self);
 bool queue_is_empty(queue_t *self);
+pthread_t queue_get(const queue_t *self, size_t pos);
 bool queue_enqueue(queue_t *self, pthread_t tid);
 pthread_t queue_dequeue(queue_t *self);
 
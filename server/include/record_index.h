@@ -0,0 +1,45 @@
+#ifndef RECORD_INDEX_H
+#define RECORD_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sidecar index of a data file made of newline terminated records: the
+ * start offset of every record, as consecutive uint64_t, so that finding
+ * record n takes one pread. It mirrors the records of the aesdchar device,
+ * except that it keeps all of them. The index is rebuilt from the data file
+ * when initialized, so it never outlives a crash in a stale state.
+ *
+ * Appending must be serialized with every other access by the caller, which
+ * holds its write lock on the data file anyway; finding only needs to exclude
+ * appends.
+ */
+struct record_index
+{
+  int fd;
+  /* Records started so far */
+  uint64_t count;
+  /* Bytes of the data file */
+  uint64_t size;
+  /* Whether the last record ends with a newline, so that the next byte starts
+   * a record */
+  bool terminated;
+};
+typedef struct record_index record_index_t;
+
+bool record_index_initialize(
+  record_index_t *self,
+  const char *filename,
+  int data_fd);
+void record_index_finalize(record_index_t *self);
+
+bool record_index_append(record_index_t *self, const char *data, size_t size);
+bool record_index_find(
+  const record_index_t *self,
+  uint64_t record,
+  uint64_t offset,
+  uint64_t *position);
+
+#endif /* RECORD_INDEX_H */
@@ -0,0 +1,62 @@
+#ifndef TIMESTAMP_FORMATTER_H
+#define TIMESTAMP_FORMATTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#define TIMESTAMP_FORMATTER_SIZE 256
+#define TIMESTAMP_FORMATTER_MAX_FIELDS 16
+
+/*
+ * strftime of the local time, cached. The text of the last second is kept and
+ * the local hour around it is formatted once: within an hour only the digits
+ * of %M, %S, %T and %R change, and they are patched in place. The same second
+ * costs a comparison and a new one a few stores. Hours are the unit as local
+ * time offsets change on hour boundaries. Formats with other conversions that
+ * change within an hour (%c, %r, %s, %X, or %M, %S, %T and %R with flags,
+ * width or modifiers) are formatted with strftime once per second instead.
+ *
+ * A formatter is not thread-safe; every thread needs its own.
+ */
+
+enum timestamp_formatter_field
+{
+  TIMESTAMP_FORMATTER_MINUTES,
+  TIMESTAMP_FORMATTER_SECONDS,
+};
+typedef enum timestamp_formatter_field timestamp_formatter_field_t;
+
+struct timestamp_formatter
+{
+  char format[TIMESTAMP_FORMATTER_SIZE];
+  bool per_second;
+  /* The format split around its fields, NUL separated */
+  char pieces[2 * TIMESTAMP_FORMATTER_SIZE];
+  timestamp_formatter_field_t fields[TIMESTAMP_FORMATTER_MAX_FIELDS];
+  size_t field_offsets[TIMESTAMP_FORMATTER_MAX_FIELDS];
+  unsigned field_count;
+  time_t hour_start;
+  time_t second;
+  size_t length;
+  char text[TIMESTAMP_FORMATTER_SIZE];
+};
+typedef struct timestamp_formatter timestamp_formatter_t;
+
+bool timestamp_formatter_initialize(
+  timestamp_formatter_t *self,
+  const char *format);
+void timestamp_formatter_finalize(timestamp_formatter_t *self);
+
+timestamp_formatter_t *timestamp_formatter_new(const char *format);
+void timestamp_formatter_destroy(timestamp_formatter_t *self);
+
+const char *timestamp_formatter_format(
+  timestamp_formatter_t *self,
+  time_t seconds,
+  size_t *length);
+const char *timestamp_formatter_now(
+  timestamp_formatter_t *self,
+  size_t *length);
+
+#endif /* TIMESTAMP_FORMATTER_H */
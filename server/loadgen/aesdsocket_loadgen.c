@@ -0,0 +1,700 @@
+/**
+ * @file aesdsocket_loadgen.c
+ * @brief Load generator and latency benchmark for aesdsocket
+ *
+ * Every connection thread sends one request per TCP connection, as the
+ * server expects, and reads the reply until the server closes the socket.
+ * A request is either a write of a random line, a read of the whole content
+ * (AESDCHAR_IOCSEEKTO:0,0), a seekto to a random record or a read of the last
+ * records only (AESDSOCKET_READLAST), in a configurable mix. In closed loop
+ * each thread sends its next request as soon as the previous one completes.
+ * In open loop requests are scheduled at a fixed total rate and latency is
+ * measured from the scheduled time, so a stalled server is not hidden by the
+ * client slowing down with it.
+ *
+ * Latencies go to log-linear histograms with 1/64 relative precision, like
+ * HdrHistogram, and are reported as p50/p90/p99/p999/max, in text or JSON.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_HOST "127.0.0.1"
+#define DEFAULT_PORT "9000"
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_DURATION_SECONDS 10
+#define DEFAULT_SEEKTO_RECORDS 10
+#define SEEKTO_COMMAND "AESDCHAR_IOCSEEKTO"
+#define READLAST_COMMAND "AESDSOCKET_READLAST"
+#define MAX_CONNECTIONS 1024
+#define MAX_LINE_SIZE (1 << 20)
+#define RECV_BUFFER_SIZE 65536
+
+/*
+ * Values below 2 * HISTOGRAM_HALF_SUB_BUCKETS have a bucket each, larger ones
+ * share HISTOGRAM_HALF_SUB_BUCKETS buckets per power of two.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 7
+#define HISTOGRAM_HALF_SUB_BUCKETS (1 << (HISTOGRAM_SUB_BUCKET_BITS - 1))
+#define HISTOGRAM_BUCKETS                                                      \
+  ((64 - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_HALF_SUB_BUCKETS)
+
+enum request_type
+{
+  REQUEST_WRITE,
+  REQUEST_READ,
+  REQUEST_SEEKTO,
+  REQUEST_LAST,
+  REQUEST_TYPES,
+};
+
+static const char *const request_type_names[] = {
+  "write",
+  "read",
+  "seekto",
+  "last",
+};
+
+enum size_distribution
+{
+  SIZE_FIXED,
+  SIZE_UNIFORM,
+  SIZE_EXPONENTIAL,
+};
+
+struct histogram
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+typedef struct histogram histogram_t;
+
+struct loadgen_config
+{
+  const char *host;
+  const char *port;
+  unsigned connections;
+  double duration_seconds;
+  uint64_t requests;
+  bool open_loop;
+  double rate;
+  enum size_distribution size_distribution;
+  size_t min_size;
+  size_t max_size;
+  double mean_size;
+  unsigned mix[REQUEST_TYPES];
+  unsigned seekto_records;
+  bool json;
+};
+typedef struct loadgen_config loadgen_config_t;
+
+struct loadgen_worker
+{
+  const loadgen_config_t *config;
+  const struct addrinfo *address;
+  unsigned index;
+  uint64_t random_state;
+  char *line;
+  char *recv_buffer;
+  histogram_t latency;
+  uint64_t completed[REQUEST_TYPES];
+  uint64_t errors;
+  uint64_t empty_replies;
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+};
+typedef struct loadgen_worker loadgen_worker_t;
+
+static volatile int loadgen_stop = 0;
+static unsigned loadgen_running = 0;
+
+static uint64_t
+loadgen_now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static unsigned
+histogram_index(uint64_t value)
+{
+  unsigned bits = value ? 64 - __builtin_clzll(value) : 0;
+  unsigned shift;
+
+  if (bits <= HISTOGRAM_SUB_BUCKET_BITS)
+    return value;
+
+  shift = bits - HISTOGRAM_SUB_BUCKET_BITS;
+
+  return shift * HISTOGRAM_HALF_SUB_BUCKETS + (value >> shift);
+}
+
+/* Largest value that falls in bucket index. */
+static uint64_t
+histogram_bucket_max(unsigned index)
+{
+  unsigned shift;
+  uint64_t sub_bucket;
+
+  if (index < 2 * HISTOGRAM_HALF_SUB_BUCKETS)
+    return index;
+
+  shift = index / HISTOGRAM_HALF_SUB_BUCKETS - 1;
+  sub_bucket = index % HISTOGRAM_HALF_SUB_BUCKETS + HISTOGRAM_HALF_SUB_BUCKETS;
+
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+static void
+histogram_add(histogram_t *histogram, uint64_t value)
+{
+  ++histogram->count;
+  histogram->sum += value;
+  if (value > histogram->max)
+    histogram->max = value;
+  ++histogram->buckets[histogram_index(value)];
+}
+
+static void
+histogram_merge(histogram_t *into, const histogram_t *from)
+{
+  into->count += from->count;
+  into->sum += from->sum;
+  if (from->max > into->max)
+    into->max = from->max;
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    into->buckets[i] += from->buckets[i];
+}
+
+static uint64_t
+histogram_percentile(const histogram_t *histogram, double percentile)
+{
+  uint64_t rank = (uint64_t)ceil(percentile / 100 * histogram->count);
+  uint64_t seen = 0;
+  uint64_t value;
+
+  if (rank == 0)
+    rank = 1;
+
+  for (unsigned i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      value = histogram_bucket_max(i);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+
+  return histogram->max;
+}
+
+/* xorshift64* */
+static uint64_t
+loadgen_random(loadgen_worker_t *worker)
+{
+  worker->random_state ^= worker->random_state >> 12;
+  worker->random_state ^= worker->random_state << 25;
+  worker->random_state ^= worker->random_state >> 27;
+
+  return worker->random_state * UINT64_C(2685821657736338717);
+}
+
+static double
+loadgen_random_unit(loadgen_worker_t *worker)
+{
+  return (loadgen_random(worker) >> 11) * (1.0 / (UINT64_C(1) << 53));
+}
+
+/* Line size including the newline. */
+static size_t
+loadgen_line_size(loadgen_worker_t *worker)
+{
+  const loadgen_config_t *config = worker->config;
+  size_t size;
+
+  switch (config->size_distribution) {
+    case SIZE_UNIFORM:
+      size = config->min_size +
+             loadgen_random(worker) % (config->max_size - config->min_size + 1);
+      break;
+    case SIZE_EXPONENTIAL:
+      size = 1 + (size_t)(-log(1 - loadgen_random_unit(worker)) *
+                          (config->mean_size - 1));
+      break;
+    default:
+      size = config->min_size;
+      break;
+  }
+
+  return size < 1 ? 1 : size > MAX_LINE_SIZE ? MAX_LINE_SIZE : size;
+}
+
+static enum request_type
+loadgen_request_type(loadgen_worker_t *worker)
+{
+  const unsigned *mix = worker->config->mix;
+  unsigned total = 0;
+  unsigned pick;
+  int type;
+
+  for (type = 0; type < REQUEST_TYPES; ++type)
+    total += mix[type];
+  pick = loadgen_random(worker) % total;
+
+  for (type = 0; pick >= mix[type]; ++type)
+    pick -= mix[type];
+
+  return type;
+}
+
+/* Returns the bytes received, or -1 if the exchange failed. */
+static ssize_t
+loadgen_exchange(loadgen_worker_t *worker, const char *request, size_t size)
+{
+  const struct addrinfo *address = worker->address;
+  ssize_t received = 0;
+  ssize_t bytes;
+  size_t sent = 0;
+  int fd;
+
+  fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  if (fd == -1)
+    return -1;
+
+  if (connect(fd, address->ai_addr, address->ai_addrlen) == -1)
+    goto fail;
+
+  while (sent < size) {
+    bytes = send(fd, request + sent, size - sent, MSG_NOSIGNAL);
+    if (bytes == -1 && errno == EINTR)
+      continue;
+    if (bytes == -1)
+      goto fail;
+    sent += bytes;
+  }
+  worker->bytes_sent += sent;
+
+  for (;;) {
+    bytes = recv(fd, worker->recv_buffer, RECV_BUFFER_SIZE, 0);
+    if (bytes == -1 && errno == EINTR)
+      continue;
+    if (bytes == -1)
+      goto fail;
+    if (bytes == 0)
+      break;
+    received += bytes;
+  }
+
+  close(fd);
+
+  return received;
+
+fail:
+  close(fd);
+
+  return -1;
+}
+
+static void
+loadgen_request(loadgen_worker_t *worker, uint64_t scheduled_ns)
+{
+  enum request_type type = loadgen_request_type(worker);
+  size_t size;
+  ssize_t received;
+
+  switch (type) {
+    case REQUEST_WRITE:
+      size = loadgen_line_size(worker);
+      memset(worker->line, 'a' + worker->index % 26, size - 1);
+      worker->line[size - 1] = '\n';
+      break;
+    case REQUEST_READ:
+      size = sprintf(worker->line, "%s:0,0\n", SEEKTO_COMMAND);
+      break;
+    case REQUEST_LAST:
+      size = sprintf(
+        worker->line,
+        "%s:%u\n",
+        READLAST_COMMAND,
+        worker->config->seekto_records);
+      break;
+    default:
+      size = sprintf(
+        worker->line,
+        "%s:%u,0\n",
+        SEEKTO_COMMAND,
+        (unsigned)(loadgen_random(worker) % worker->config->seekto_records));
+      break;
+  }
+
+  received = loadgen_exchange(worker, worker->line, size);
+  if (received < 0) {
+    ++worker->errors;
+    return;
+  }
+
+  histogram_add(&worker->latency, loadgen_now_ns() - scheduled_ns);
+  ++worker->completed[type];
+  worker->bytes_received += received;
+  if (received == 0)
+    ++worker->empty_replies;
+}
+
+static void *
+loadgen_run_worker(void *arg)
+{
+  loadgen_worker_t *worker = arg;
+  const loadgen_config_t *config = worker->config;
+  uint64_t requests = config->requests / config->connections +
+                      (worker->index < config->requests % config->connections);
+  uint64_t interval_ns = 0;
+  uint64_t scheduled_ns = loadgen_now_ns();
+  struct timespec wakeup;
+
+  if (config->open_loop) {
+    interval_ns = (uint64_t)(1e9 * config->connections / config->rate);
+    scheduled_ns += interval_ns * worker->index / config->connections;
+  }
+
+  for (uint64_t i = 0; !loadgen_stop && (!config->requests || i < requests);
+       ++i) {
+    if (config->open_loop) {
+      wakeup.tv_sec = scheduled_ns / 1000000000;
+      wakeup.tv_nsec = scheduled_ns % 1000000000;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL) ==
+             EINTR)
+        ;
+    } else {
+      scheduled_ns = loadgen_now_ns();
+    }
+
+    loadgen_request(worker, scheduled_ns);
+    scheduled_ns += interval_ns;
+  }
+
+  __atomic_sub_fetch(&loadgen_running, 1, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+static bool
+loadgen_parse_sizes(loadgen_config_t *config, const char *text)
+{
+  char *end;
+
+  if (strncmp(text, "exp:", 4) == 0) {
+    config->size_distribution = SIZE_EXPONENTIAL;
+    config->mean_size = strtod(text + 4, &end);
+    return *end == '\0' && config->mean_size >= 1;
+  }
+
+  config->min_size = strtoul(text, &end, 10);
+  if (*end == '\0') {
+    config->size_distribution = SIZE_FIXED;
+    return config->min_size >= 1;
+  }
+
+  if (*end != '-')
+    return false;
+  config->size_distribution = SIZE_UNIFORM;
+  config->max_size = strtoul(end + 1, &end, 10);
+
+  return *end == '\0' && config->min_size >= 1 &&
+         config->max_size >= config->min_size;
+}
+
+/* The last weight may be left out. */
+static bool
+loadgen_parse_mix(loadgen_config_t *config, const char *text)
+{
+  config->mix[REQUEST_LAST] = 0;
+
+  return sscanf(
+           text,
+           "%u:%u:%u:%u",
+           &config->mix[REQUEST_WRITE],
+           &config->mix[REQUEST_READ],
+           &config->mix[REQUEST_SEEKTO],
+           &config->mix[REQUEST_LAST]) >= 3 &&
+         config->mix[REQUEST_WRITE] + config->mix[REQUEST_READ] +
+             config->mix[REQUEST_SEEKTO] + config->mix[REQUEST_LAST] >
+           0;
+}
+
+static void
+loadgen_usage(const char *program)
+{
+  fprintf(
+    stderr,
+    "usage: %s [-H host] [-p port] [-c connections] [-d seconds] "
+    "[-n requests]\n"
+    "          [-r rate] [-s size|min-max|exp:mean] "
+    "[-x write:read:seekto[:last]]\n"
+    "          [-k records] [-j]\n"
+    "  -r rate  open loop at rate requests/s in total (default closed loop)\n"
+    "  -s       line size in bytes with its newline (default 64)\n"
+    "  -x       request mix weights (default 100:0:0:0)\n"
+    "  -k       records seekto picks from and last reads (default 10)\n"
+    "  -j       JSON output\n",
+    program);
+}
+
+static void
+loadgen_report(
+  const loadgen_config_t *config,
+  const loadgen_worker_t *total,
+  double elapsed_seconds)
+{
+  const histogram_t *latency = &total->latency;
+  uint64_t completed = latency->count;
+  double mean_ns = completed ? (double)latency->sum / completed : 0;
+
+  if (config->json) {
+    printf(
+      "{\"mode\": \"%s\", \"connections\": %u, \"elapsed_s\": %.3f, "
+      "\"requests\": %" PRIu64 ", \"writes\": %" PRIu64 ", \"reads\": %" PRIu64
+      ", \"seektos\": %" PRIu64 ", \"lasts\": %" PRIu64
+      ", \"errors\": %" PRIu64
+      ", \"empty_replies\": %" PRIu64 ", \"requests_per_s\": %.1f, "
+      "\"received_bytes_per_s\": %.1f, \"latency_ns\": {\"mean\": %.0f, "
+      "\"p50\": %" PRIu64 ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64
+      ", \"p999\": %" PRIu64 ", \"max\": %" PRIu64 "}}\n",
+      config->open_loop ? "open" : "closed",
+      config->connections,
+      elapsed_seconds,
+      completed,
+      total->completed[REQUEST_WRITE],
+      total->completed[REQUEST_READ],
+      total->completed[REQUEST_SEEKTO],
+      total->completed[REQUEST_LAST],
+      total->errors,
+      total->empty_replies,
+      completed / elapsed_seconds,
+      total->bytes_received / elapsed_seconds,
+      mean_ns,
+      histogram_percentile(latency, 50),
+      histogram_percentile(latency, 90),
+      histogram_percentile(latency, 99),
+      histogram_percentile(latency, 99.9),
+      latency->max);
+    return;
+  }
+
+  printf(
+    "%s loop, %u connections, %.2f s\n",
+    config->open_loop ? "open" : "closed",
+    config->connections,
+    elapsed_seconds);
+  for (int type = 0; type < REQUEST_TYPES; ++type)
+    printf(
+      "  %-8s %12" PRIu64 " requests\n",
+      request_type_names[type],
+      total->completed[type]);
+  printf(
+    "  errors %" PRIu64 ", empty replies %" PRIu64 "\n"
+    "  %.1f requests/s, %.1f KiB/s sent, %.1f KiB/s received\n"
+    "  latency (us): mean %.1f p50 %.1f p90 %.1f p99 %.1f p999 %.1f "
+    "max %.1f\n",
+    total->errors,
+    total->empty_replies,
+    completed / elapsed_seconds,
+    total->bytes_sent / elapsed_seconds / 1024,
+    total->bytes_received / elapsed_seconds / 1024,
+    mean_ns / 1e3,
+    histogram_percentile(latency, 50) / 1e3,
+    histogram_percentile(latency, 90) / 1e3,
+    histogram_percentile(latency, 99) / 1e3,
+    histogram_percentile(latency, 99.9) / 1e3,
+    latency->max / 1e3);
+}
+
+int
+main(int argc, char *argv[])
+{
+  loadgen_config_t config = {
+    .host = DEFAULT_HOST,
+    .port = DEFAULT_PORT,
+    .connections = DEFAULT_CONNECTIONS,
+    .duration_seconds = -1,
+    .size_distribution = SIZE_FIXED,
+    .min_size = 64,
+    .mix = { 100, 0, 0, 0 },
+    .seekto_records = DEFAULT_SEEKTO_RECORDS,
+  };
+  struct addrinfo hints;
+  struct addrinfo *address = NULL;
+  loadgen_worker_t *workers = NULL;
+  loadgen_worker_t *total = NULL;
+  pthread_t *tids = NULL;
+  unsigned started = 0;
+  uint64_t start_ns;
+  uint64_t deadline_ns;
+  struct timespec pause = { 0, 10000000 };
+  int exit_status = EXIT_FAILURE;
+  int option;
+  int status;
+
+  while ((option = getopt(argc, argv, "H:p:c:d:n:r:s:x:k:j")) != -1) {
+    switch (option) {
+      case 'H':
+        config.host = optarg;
+        break;
+      case 'p':
+        config.port = optarg;
+        break;
+      case 'c':
+        config.connections = strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        config.duration_seconds = strtod(optarg, NULL);
+        break;
+      case 'n':
+        config.requests = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        config.open_loop = true;
+        config.rate = strtod(optarg, NULL);
+        break;
+      case 's':
+        if (!loadgen_parse_sizes(&config, optarg)) {
+          fprintf(stderr, "invalid size distribution %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'x':
+        if (!loadgen_parse_mix(&config, optarg)) {
+          fprintf(stderr, "invalid request mix %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'k':
+        config.seekto_records = strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        config.json = true;
+        break;
+      default:
+        loadgen_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  if (config.duration_seconds < 0)
+    config.duration_seconds = config.requests ? 0 : DEFAULT_DURATION_SECONDS;
+
+  if (
+    config.connections == 0 || config.connections > MAX_CONNECTIONS ||
+    (config.open_loop && config.rate <= 0) || config.seekto_records == 0 ||
+    (config.duration_seconds == 0 && config.requests == 0)) {
+    loadgen_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if ((status = getaddrinfo(config.host, config.port, &hints, &address))) {
+    fprintf(
+      stderr,
+      "%s:%s: %s\n",
+      config.host,
+      config.port,
+      gai_strerror(status));
+    return EXIT_FAILURE;
+  }
+
+  if (
+    !(workers = calloc(config.connections, sizeof(loadgen_worker_t))) ||
+    !(total = calloc(1, sizeof(loadgen_worker_t))) ||
+    !(tids = calloc(config.connections, sizeof(pthread_t))))
+    goto done;
+
+  for (unsigned i = 0; i < config.connections; ++i) {
+    workers[i].config = &config;
+    workers[i].address = address;
+    workers[i].index = i;
+    workers[i].random_state = UINT64_C(0x9E3779B97F4A7C15) * (i + 1);
+    if (
+      !(workers[i].line = malloc(MAX_LINE_SIZE)) ||
+      !(workers[i].recv_buffer = malloc(RECV_BUFFER_SIZE)))
+      goto done;
+  }
+
+  start_ns = loadgen_now_ns();
+  deadline_ns = start_ns + (uint64_t)(config.duration_seconds * 1e9);
+  loadgen_running = config.connections;
+  for (; started < config.connections; ++started) {
+    if (pthread_create(
+          &tids[started],
+          NULL,
+          loadgen_run_worker,
+          &workers[started]))
+      break;
+  }
+  loadgen_running -= config.connections - started;
+
+  /* With -n alone the workers stop by themselves. */
+  if (config.duration_seconds > 0) {
+    while (
+      loadgen_now_ns() < deadline_ns &&
+      __atomic_load_n(&loadgen_running, __ATOMIC_ACQUIRE))
+      nanosleep(&pause, NULL);
+    loadgen_stop = 1;
+  }
+
+  for (unsigned i = 0; i < started; ++i)
+    pthread_join(tids[i], NULL);
+
+  if (started != config.connections) {
+    fprintf(
+      stderr,
+      "couldn't start %u connection threads\n",
+      config.connections);
+    goto done;
+  }
+
+  for (unsigned i = 0; i < config.connections; ++i) {
+    histogram_merge(&total->latency, &workers[i].latency);
+    for (int type = 0; type < REQUEST_TYPES; ++type)
+      total->completed[type] += workers[i].completed[type];
+    total->errors += workers[i].errors;
+    total->empty_replies += workers[i].empty_replies;
+    total->bytes_sent += workers[i].bytes_sent;
+    total->bytes_received += workers[i].bytes_received;
+  }
+
+  loadgen_report(&config, total, (loadgen_now_ns() - start_ns) / 1e9);
+
+  exit_status = total->errors ? EXIT_FAILURE : EXIT_SUCCESS;
+
+done:
+  if (workers) {
+    for (unsigned i = 0; i < config.connections; ++i) {
+      free(workers[i].line);
+      free(workers[i].recv_buffer);
+    }
+    free(workers);
+  }
+  free(total);
+  free(tids);
+  freeaddrinfo(address);
+
+  return exit_status;
+}
@@ -5,40 +5,58 @@
 #include <asm-generic/errno-base.h>
 #include <asm-generic/errno.h>
 #include <asm-generic/socket.h>
-#include <bits/pthreadtypes.h>
 #include <bits/time.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <inttypes.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/syslog.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "aesd_ioctl.h"
+#include "aesdsocket_command.h"
+#include "aesdsocket_probes.h"
 #include "monitor.h"
+#include "monitor_profile.h"
 #include "queue.h"
+#include "record_index.h"
+#include "timestamp_formatter.h"
 #include "try.h"
 
 #define BUFFSIZE 1024
+/* Fits "seq=" UINT64_MAX " recv=" INT64_MAX ".999999999 " */
+#define RECORD_HEADER_SIZE 64
+#define PROTOCOL_ERROR_PREFIX "ERROR: "
 
 static volatile sig_atomic_t termination_flag = 0;
-static volatile sig_atomic_t timestamp_flag = 0;
+#ifdef MONITOR_PROFILE
+static volatile sig_atomic_t profile_dump_flag = 0;
+#endif /* MONITOR_PROFILE */
 
 static void aesdsocket_terminate_handler(int signo);
-static void aesdsocket_timestamp_handler(int signo);
+#ifdef MONITOR_PROFILE
+static void aesdsocket_profile_dump_handler(int signo);
+#endif /* MONITOR_PROFILE */
 static bool aesdsocket_daemonize(void);
 static bool aesdsocket_open_listening_socket(
   int *sockfd,
@@ -46,9 +64,29 @@ static bool aesdsocket_open_listening_socket(
   int backlog);
 static const void *aesdsocket_get_in_addr(const struct sockaddr *sa);
 static bool aesdsocket_take_timestamp(
-  const char *timestamp_format,
-  const char *filename,
-  monitor_t *file_monitor);
+  timestamp_formatter_t *formatter,
+  int file_fd,
+  monitor_t *file_monitor,
+  record_index_t *record_index);
+
+/* The timestamp thread appends to file_fd at every expiration of timer_fd. */
+struct aesdsocket_timestamp_arg
+{
+  int timer_fd;
+  /* Written to once to stop the thread */
+  int stop_fd;
+  int file_fd;
+  timestamp_formatter_t formatter;
+  monitor_t *file_monitor;
+  record_index_t *record_index;
+};
+typedef struct aesdsocket_timestamp_arg aesdsocket_timestamp_arg_t;
+
+static bool aesdsocket_start_timestamp_thread(
+  pthread_t *tid,
+  aesdsocket_timestamp_arg_t *timestamp_arg,
+  time_t timestamp_frequency_seconds);
+static void *aesdsocket_timestamp_thread(void *arg);
 
 struct aesdsocket_thread_arg
 {
@@ -56,7 +94,12 @@ struct aesdsocket_thread_arg
   char *filename;
   char *remote_name;
   monitor_t *file_monitor;
-  const char *seekto_command;
+  /* Indexed by aesdsocket_command_type_t */
+  const char *const *command_names;
+  /* Shared by every connection, NULL unless records are stamped */
+  uint64_t *record_sequence;
+  /* NULL unless the file is regular */
+  record_index_t *record_index;
 };
 typedef struct aesdsocket_thread_arg aesdsocket_thread_arg_t;
 
@@ -65,21 +108,41 @@ static bool aesdsocket_serve(
   int socket_fd,
   const char *filename,
   monitor_t *file_monitor,
-  const char *seekto_command);
-static bool aesdsocket_recv_line(int socket_fd, char **line);
+  const char *const command_names[AESDSOCKET_COMMAND_COUNT],
+  uint64_t *record_sequence,
+  record_index_t *record_index);
+static bool aesdsocket_seekto(
+  int file_fd,
+  struct aesd_seekto *seekto_arg,
+  monitor_t *file_monitor,
+  const record_index_t *record_index);
+static bool aesdsocket_seek_range(
+  int file_fd,
+  const aesdsocket_command_t *command,
+  monitor_t *file_monitor,
+  const record_index_t *record_index,
+  uint64_t *end);
+static bool aesdsocket_recv_line(int socket_fd, char **line, size_t *size);
+static bool aesdsocket_send_error(int socket_fd, const char *error);
+static bool aesdsocket_format_record_header(
+  char *header,
+  uint64_t *record_sequence);
 static bool aesdsocket_write_line(
   int file_fd,
+  const char *header,
   const char *line,
-  monitor_t *file_monitor);
+  monitor_t *file_monitor,
+  record_index_t *record_index);
 static bool aesdsocket_read_and_send_file(
   int socket_fd,
   int file_fd,
-  monitor_t *file_monitor);
-static bool aesdsocket_read_line(
-  int file_fd,
-  char **line,
-  bool *eof,
-  monitor_t *file_monitor);
+  monitor_t *file_monitor,
+  const record_index_t *record_index,
+  uint64_t end);
+static bool aesdsocket_send_buffer(
+  int socket_fd,
+  const char *buffer,
+  size_t size);
 static bool aesdsocket_send_line(int socket_fd, const char *line);
 
 void
@@ -91,12 +154,14 @@ aesdsocket_terminate_handler(int signo)
   }
 }
 
+#ifdef MONITOR_PROFILE
 void
-aesdsocket_timestamp_handler(int signo)
+aesdsocket_profile_dump_handler(int signo)
 {
-  if (signo == SIGALRM)
-    timestamp_flag = 1;
+  if (signo == SIGUSR1)
+    profile_dump_flag = 1;
 }
+#endif /* MONITOR_PROFILE */
 
 bool
 aesdsocket_daemonize(void)
@@ -178,66 +243,151 @@ aesdsocket_get_in_addr(const struct sockaddr *sa)
 
 bool
 aesdsocket_take_timestamp(
-  const char *timestamp_format,
-  const char *filename,
-  monitor_t *file_monitor)
+  timestamp_formatter_t *formatter,
+  int file_fd,
+  monitor_t *file_monitor,
+  record_index_t *record_index)
 {
   bool ok = false;
-  struct timespec timestamp;
-  struct tm local_timestamp;
-  char timestamp_buffer[BUFFSIZE] = "";
+  const char *timestamp;
+  char timestamp_buffer[TIMESTAMP_FORMATTER_SIZE + 1] = "";
   size_t timestamp_size = 0;
-  int file_fd = -1;
 
-  TRYC_ERRNO(
-    file_fd = open(
-      filename,
-      O_WRONLY | O_APPEND | O_CREAT,
-      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
-
-  TRYC_ERRNO(clock_gettime(CLOCK_REALTIME, &timestamp));
-  TRY(
-    localtime_r(&timestamp.tv_sec, &local_timestamp),
-    "localtime timestamp conversion failed");
   TRY(
-    timestamp_size =
-      strftime(timestamp_buffer, BUFFSIZE, timestamp_format, &local_timestamp),
+    timestamp = timestamp_formatter_now(formatter, &timestamp_size),
     "timestamp string creation failed");
+  memcpy(timestamp_buffer, timestamp, timestamp_size);
   timestamp_buffer[timestamp_size] = '\n';
   timestamp_buffer[timestamp_size + 1] = '\0';
 
   syslog(LOG_DEBUG, "%s\n", timestamp_buffer);
   TRY(
-    aesdsocket_write_line(file_fd, timestamp_buffer, file_monitor),
+    aesdsocket_write_line(
+      file_fd,
+      NULL,
+      timestamp_buffer,
+      file_monitor,
+      record_index),
     "couldn't write the timestamp to the file");
 
   ok = true;
 
 done:
-  if (file_fd != -1)
-    close(file_fd);
+  return ok;
+}
 
+/*
+ * Arms the timer and starts the thread with every signal blocked, so that
+ * termination signals still interrupt accept in the main thread.
+ */
+bool
+aesdsocket_start_timestamp_thread(
+  pthread_t *tid,
+  aesdsocket_timestamp_arg_t *timestamp_arg,
+  time_t timestamp_frequency_seconds)
+{
+  bool ok = false;
+  struct itimerspec timestamp_frequency;
+  sigset_t blocked;
+  sigset_t previous;
+  int status;
+
+  memset(&timestamp_frequency, 0, sizeof(timestamp_frequency));
+  timestamp_frequency.it_value.tv_sec = timestamp_frequency_seconds;
+  timestamp_frequency.it_interval.tv_sec = timestamp_frequency_seconds;
+  TRYC_ERRNO(timerfd_settime(
+    timestamp_arg->timer_fd,
+    0,
+    &timestamp_frequency,
+    NULL));
+
+  sigfillset(&blocked);
+  pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+  status = pthread_create(
+    tid,
+    NULL,
+    aesdsocket_timestamp_thread,
+    timestamp_arg);
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  if (status) {
+    errno = status;
+    LOG_ERROR(strerror(errno));
+    goto done;
+  }
+
+  ok = true;
+
+done:
   return ok;
 }
 
+/* Timestamps missed while the file was busy are not made up for. */
+void *
+aesdsocket_timestamp_thread(void *arg)
+{
+  aesdsocket_timestamp_arg_t *timestamp_arg = arg;
+  struct pollfd fds[2] = {
+    { .fd = timestamp_arg->timer_fd, .events = POLLIN },
+    { .fd = timestamp_arg->stop_fd, .events = POLLIN },
+  };
+  uint64_t expirations;
+
+  while (!fds[1].revents) {
+    TRYC_CONTINUE_ON_EINTR(poll(fds, 2, -1));
+    if (!(fds[0].revents & POLLIN))
+      continue;
+
+    TRYC_CONTINUE_ON_EINTR(
+      read(timestamp_arg->timer_fd, &expirations, sizeof(expirations)));
+    if (expirations > 1)
+      syslog(LOG_WARNING, "%" PRIu64 " timestamps missed\n", expirations - 1);
+
+    TRY(
+      aesdsocket_take_timestamp(
+        &timestamp_arg->formatter,
+        timestamp_arg->file_fd,
+        timestamp_arg->file_monitor,
+        timestamp_arg->record_index),
+      "couldn't take timestamp");
+  }
+
+done:
+  return NULL;
+}
+
 void *
 aesdsocket_start_thread(void *arg)
 {
+  bool ok = false;
   aesdsocket_thread_arg_t *thread_arg = arg;
   int conn_sockfd = thread_arg->conn_sockfd;
   char *filename = thread_arg->filename;
   char *remote_name = thread_arg->remote_name;
   monitor_t *file_monitor = thread_arg->file_monitor;
-  const char *seekto_command = thread_arg->seekto_command;
+  const char *const *command_names = thread_arg->command_names;
+  uint64_t *record_sequence = thread_arg->record_sequence;
+  record_index_t *record_index = thread_arg->record_index;
   free(thread_arg);
 
+  AESDSOCKET_PROBE1(request__start, conn_sockfd);
   syslog(LOG_DEBUG, "Accepted connection from %s\n", remote_name);
 
   TRY(
-    aesdsocket_serve(conn_sockfd, filename, file_monitor, seekto_command),
+    aesdsocket_serve(
+      conn_sockfd,
+      filename,
+      file_monitor,
+      command_names,
+      record_sequence,
+      record_index),
     "thread execution failed");
 
+  ok = true;
+
 done:
+  AESDSOCKET_PROBE2(request__done, conn_sockfd, ok);
+
   if (conn_sockfd != -1)
     close(conn_sockfd);
 
@@ -257,18 +407,19 @@ aesdsocket_serve(
   int socket_fd,
   const char *filename,
   monitor_t *file_monitor,
-  const char *seekto_command)
+  const char *const command_names[AESDSOCKET_COMMAND_COUNT],
+  uint64_t *record_sequence,
+  record_index_t *record_index)
 {
   bool ok = false;
   char *line = NULL;
+  size_t line_size = 0;
+  char header[RECORD_HEADER_SIZE] = "";
   int file_fd = -1;
+  aesdsocket_command_t command = { .type = AESDSOCKET_COMMAND_NONE };
+  const char *error = NULL;
   struct aesd_seekto seekto_arg;
-  char *command_ptr;
-  size_t command_size;
-  char *command_offset_ptr;
-  size_t command_offset_size;
-  char *end_ptr;
-  char command_buffer[BUFFSIZE] = {};
+  uint64_t end = UINT64_MAX;
 
   TRYC_ERRNO(
     file_fd = open(
@@ -276,32 +427,74 @@ aesdsocket_serve(
       O_RDWR | O_APPEND | O_CREAT,
       S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
 
-  TRY(aesdsocket_recv_line(socket_fd, &line), "line reception failed");
-  if (line) {
-    if (strncmp(line, seekto_command, strlen(seekto_command)) == 0) {
-      command_ptr = strchr(line, ':');
-      if (command_ptr) {
-        ++command_ptr;
-        command_offset_ptr = strchr(command_ptr, ',');
-        if (command_offset_ptr) {
-          command_size = command_offset_ptr - command_ptr;
-          ++command_offset_ptr;
-          end_ptr = strchr(command_offset_ptr, '\n');
-          if (end_ptr) {
-            command_offset_size = end_ptr - command_offset_ptr;
-            strncpy(command_buffer, command_ptr, command_size);
-            command_buffer[command_size] = '\0';
-            seekto_arg.write_cmd = atoi(command_buffer);
-            strncpy(command_buffer, command_offset_ptr, command_offset_size);
-            command_buffer[command_offset_size] = '\0';
-            seekto_arg.write_cmd_offset = atoi(command_buffer);
-            TRYC_ERRNO(ioctl(file_fd, AESDCHAR_IOCSEEKTO, &seekto_arg));
-          }
-        }
+  TRY(
+    aesdsocket_recv_line(socket_fd, &line, &line_size),
+    "line reception failed");
+  AESDSOCKET_PROBE2(recv__done, socket_fd, line_size);
+  if (
+    line &&
+    !aesdsocket_command_parse(
+      command_names,
+      line,
+      line_size,
+      &command,
+      &error)) {
+    syslog(LOG_DEBUG, "Protocol error: %s\n", error);
+    TRY(aesdsocket_send_error(socket_fd, error), "error reply failed");
+    ok = true;
+    goto done;
+  }
+
+  switch (command.type) {
+    case AESDSOCKET_COMMAND_SEEKTO:
+      seekto_arg.write_cmd = command.arguments[0];
+      seekto_arg.write_cmd_offset = command.arguments[1];
+      AESDSOCKET_PROBE3(
+        seekto,
+        socket_fd,
+        seekto_arg.write_cmd,
+        seekto_arg.write_cmd_offset);
+      if (!aesdsocket_seekto(
+            file_fd,
+            &seekto_arg,
+            file_monitor,
+            record_index)) {
+        TRY(errno == EINVAL, strerror(errno));
+        TRY(
+          aesdsocket_send_error(socket_fd, "no such record or offset"),
+          "error reply failed");
+        ok = true;
+        goto done;
+      }
+      break;
+    case AESDSOCKET_COMMAND_READ_BYTES:
+    case AESDSOCKET_COMMAND_READ_LAST:
+    case AESDSOCKET_COMMAND_READ_SINCE:
+      TRY(
+        aesdsocket_seek_range(
+          file_fd,
+          &command,
+          file_monitor,
+          record_index,
+          &end),
+        "range lookup failed");
+      break;
+    case AESDSOCKET_COMMAND_NONE:
+      if (!line)
+        break;
+
+      if (record_sequence) {
+        TRY(
+          aesdsocket_format_record_header(header, record_sequence),
+          "record header creation failed");
       }
-    } else {
       TRY(
-        aesdsocket_write_line(file_fd, line, file_monitor),
+        aesdsocket_write_line(
+          file_fd,
+          header,
+          line,
+          file_monitor,
+          record_index),
         "line writing failed");
 
       close(file_fd);
@@ -312,11 +505,18 @@ aesdsocket_serve(
           filename,
           O_RDONLY | O_APPEND | O_CREAT,
           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
-    }
+      break;
+    default:
+      break;
   }
 
   TRY(
-    aesdsocket_read_and_send_file(socket_fd, file_fd, file_monitor),
+    aesdsocket_read_and_send_file(
+      socket_fd,
+      file_fd,
+      file_monitor,
+      record_index,
+      end),
     "line reading or sending failed");
 
   ok = true;
@@ -331,8 +531,126 @@ done:
   return ok;
 }
 
+/*
+ * AESDCHAR_IOCSEEKTO, or the same through the record index if the file is
+ * regular. Fails with errno EINVAL if the record or offset does not exist.
+ */
+bool
+aesdsocket_seekto(
+  int file_fd,
+  struct aesd_seekto *seekto_arg,
+  monitor_t *file_monitor,
+  const record_index_t *record_index)
+{
+  bool ok = false;
+  uint64_t position;
+  bool found;
+
+  if (!record_index)
+    return ioctl(file_fd, AESDCHAR_IOCSEEKTO, seekto_arg) == 0;
+
+  AESDSOCKET_PROBE1(lock__wait, MONITOR_PROFILE_READ);
+  monitor_start_reading(file_monitor);
+  AESDSOCKET_PROBE1(lock__acquired, MONITOR_PROFILE_READ);
+  found = record_index_find(
+    record_index,
+    seekto_arg->write_cmd,
+    seekto_arg->write_cmd_offset,
+    &position);
+  monitor_stop_reading(file_monitor);
+  AESDSOCKET_PROBE1(lock__released, MONITOR_PROFILE_READ);
+
+  if (found && lseek(file_fd, position, SEEK_SET) != -1)
+    ok = true;
+
+  return ok;
+}
+
+/*
+ * Moves file_fd to the start of the range of command, one of the READ
+ * commands, and stores where the range ends, UINT64_MAX for the end of the
+ * file. Records come from the record index or, on the device, from
+ * AESDCHAR_IOCGETINDEX, whose generation numbers them across evictions.
+ * Ranges which start past the end are empty.
+ */
 bool
-aesdsocket_recv_line(int socket_fd, char **line)
+aesdsocket_seek_range(
+  int file_fd,
+  const aesdsocket_command_t *command,
+  monitor_t *file_monitor,
+  const record_index_t *record_index,
+  uint64_t *end)
+{
+  bool ok = false;
+  bool empty = false;
+  uint64_t start = 0;
+  uint64_t oldest = 0;
+  uint64_t count;
+  uint64_t first;
+  struct aesd_index device_index;
+
+  AESDSOCKET_PROBE1(lock__wait, MONITOR_PROFILE_READ);
+  monitor_start_reading(file_monitor);
+  AESDSOCKET_PROBE1(lock__acquired, MONITOR_PROFILE_READ);
+
+  if (command->type == AESDSOCKET_COMMAND_READ_BYTES) {
+    /* Both are at most INT64_MAX */
+    start = command->arguments[0];
+    *end = command->arguments[0] + command->arguments[1];
+  } else {
+    *end = UINT64_MAX;
+    if (record_index) {
+      count = record_index->count;
+    } else {
+      TRYC_ERRNO(ioctl(file_fd, AESDCHAR_IOCGETINDEX, &device_index));
+      count = device_index.entry_count;
+      oldest = device_index.generation - count;
+    }
+
+    if (command->type == AESDSOCKET_COMMAND_READ_LAST)
+      first = oldest + count - (command->arguments[0] < count
+                                  ? command->arguments[0]
+                                  : count);
+    else
+      first = command->arguments[0] > oldest ? command->arguments[0] : oldest;
+
+    if (first >= oldest + count) {
+      empty = true;
+    } else if (record_index) {
+      TRY(
+        record_index_find(record_index, first, 0, &start),
+        "record lookup failed");
+    } else {
+      start = device_index.entry[first - oldest].offset;
+    }
+  }
+
+  /*
+   * The device refuses to seek past its end. An empty range also ends where
+   * it starts, so that nothing is sent whatever a read at the end returns.
+   */
+  if (empty || lseek(file_fd, start, SEEK_SET) == -1) {
+    TRY(empty || errno == EINVAL, strerror(errno));
+    TRYC_ERRNO(lseek(file_fd, 0, SEEK_END));
+    *end = 0;
+  }
+
+  ok = true;
+
+done:
+  monitor_stop_reading(file_monitor);
+  AESDSOCKET_PROBE1(lock__released, MONITOR_PROFILE_READ);
+
+  return ok;
+}
+
+/*
+ * Receives up to and including the first newline, or until the peer shuts
+ * down. line is NUL terminated and size does not count the NUL, which may
+ * not be the first one as the peer may send NULs.
+ */
+bool
+aesdsocket_recv_line(int socket_fd, char **line, size_t *size)
 {
   bool ok = false;
   bool eol = false;
@@ -350,7 +668,7 @@ aesdsocket_recv_line(int socket_fd, char **line)
       ssize_t useful_bytes;
       char *newline_pointer = NULL;
 
-      if ((newline_pointer = strchr(buffer, '\n')) != NULL) {
+      if ((newline_pointer = memchr(buffer, '\n', bytes_read)) != NULL) {
         eol = true;
         useful_bytes = newline_pointer - buffer + 1;
       } else {
@@ -362,9 +680,12 @@ aesdsocket_recv_line(int socket_fd, char **line)
           line_buffer =
             (char *)realloc(line_buffer, line_buffer_size + useful_bytes + 1),
           "memory allocation failed");
-        strncpy(line_buffer + line_buffer_size, buffer, useful_bytes);
+        memcpy(line_buffer + line_buffer_size, buffer, useful_bytes);
         line_buffer_size += useful_bytes;
       }
+    } else {
+      /* The peer shut down before sending a newline */
+      break;
     }
   }
 
@@ -373,6 +694,7 @@ aesdsocket_recv_line(int socket_fd, char **line)
 
   ok = true;
   *line = line_buffer;
+  *size = line_buffer_size;
 
 done:
   if (!ok && !(*line) && line_buffer)
@@ -381,128 +703,199 @@ done:
   return ok;
 }
 
+/*
+ * Writes "seq=<sequence> recv=<seconds>.<nanoseconds> " to header. The
+ * sequence is taken without locking when the packet has been received, so it
+ * gives the arrival order across connections, while records of concurrent
+ * connections may reach the file in a slightly different order. The receive
+ * time is CLOCK_REALTIME, comparable with the clock of the consumers.
+ */
 bool
-aesdsocket_write_line(int file_fd, const char *line, monitor_t *file_monitor)
+aesdsocket_format_record_header(char *header, uint64_t *record_sequence)
 {
   bool ok = false;
-  size_t bytes_to_write = strlen(line);
+  uint64_t sequence = __atomic_fetch_add(record_sequence, 1, __ATOMIC_RELAXED);
+  struct timespec received;
+
+  TRYC_ERRNO(clock_gettime(CLOCK_REALTIME, &received));
+  snprintf(
+    header,
+    RECORD_HEADER_SIZE,
+    "seq=%" PRIu64 " recv=%lld.%09ld ",
+    sequence,
+    (long long)received.tv_sec,
+    received.tv_nsec);
+
+  ok = true;
 
+done:
+  return ok;
+}
+
+/*
+ * Appends header, which may be NULL, and line with a single writev, so that
+ * they are never split by another record, and indexes them if record_index
+ * is not NULL.
+ */
+bool
+aesdsocket_write_line(
+  int file_fd,
+  const char *header,
+  const char *line,
+  monitor_t *file_monitor,
+  record_index_t *record_index)
+{
+  bool ok = false;
+  bool locked = false;
+  size_t header_size = header ? strlen(header) : 0;
+  size_t line_size = strlen(line);
+  struct iovec iov[2] = {
+    { .iov_base = (char *)(header ? header : ""), .iov_len = header_size },
+    { .iov_base = (char *)line, .iov_len = line_size },
+  };
+  struct iovec *next = iov;
+  int count = 2;
+  size_t bytes_to_write = header_size + line_size;
+
+  AESDSOCKET_PROBE1(lock__wait, MONITOR_PROFILE_WRITE);
   monitor_start_writing(file_monitor);
+  locked = true;
+  AESDSOCKET_PROBE1(lock__acquired, MONITOR_PROFILE_WRITE);
   while (bytes_to_write > 0) {
     ssize_t bytes_written;
-    TRYC_RETRY_ON_EINTR(
-      bytes_written =
-        write(file_fd, line + strlen(line) - bytes_to_write, bytes_to_write));
+    TRYC_RETRY_ON_EINTR(bytes_written = writev(file_fd, next, count));
     bytes_to_write -= bytes_written;
+    /* Skips what was written after a short write */
+    while (count && (size_t)bytes_written >= next->iov_len) {
+      bytes_written -= next->iov_len;
+      ++next;
+      --count;
+    }
+    if (count) {
+      next->iov_base = (char *)next->iov_base + bytes_written;
+      next->iov_len -= bytes_written;
+    }
+  }
+  AESDSOCKET_PROBE1(append__done, header_size + line_size);
+
+  if (record_index) {
+    TRY(
+      record_index_append(record_index, header, header_size) &&
+        record_index_append(record_index, line, line_size),
+      "record indexing failed");
   }
-  monitor_stop_writing(file_monitor);
 
   ok = true;
 
 done:
+  if (locked) {
+    monitor_stop_writing(file_monitor);
+    AESDSOCKET_PROBE1(lock__released, MONITOR_PROFILE_WRITE);
+  }
+
   return ok;
 }
 
+/*
+ * Sends the file from its current position up to end, or to the end of the
+ * file if that comes first. A regular file, which only grows, is sent with
+ * sendfile up to its size when the request started, as what lies below is
+ * complete and never changes. The device is read under the read lock, a
+ * buffer at a time.
+ */
 bool
 aesdsocket_read_and_send_file(
   int socket_fd,
   int file_fd,
-  monitor_t *file_monitor)
+  monitor_t *file_monitor,
+  const record_index_t *record_index,
+  uint64_t end)
 {
   bool ok = false;
-  bool eof = false;
-  char *line = NULL;
+  char buffer[BUFFSIZE];
+  ssize_t bytes_read;
+  ssize_t bytes_sent;
+  off_t position;
+  uint64_t size;
+  size_t bytes_to_read;
+
+  TRYC_ERRNO(position = lseek(file_fd, 0, SEEK_CUR));
+
+  if (record_index) {
+    AESDSOCKET_PROBE1(lock__wait, MONITOR_PROFILE_READ);
+    monitor_start_reading(file_monitor);
+    AESDSOCKET_PROBE1(lock__acquired, MONITOR_PROFILE_READ);
+    size = record_index->size < end ? record_index->size : end;
+    monitor_stop_reading(file_monitor);
+    AESDSOCKET_PROBE1(lock__released, MONITOR_PROFILE_READ);
+
+    while ((uint64_t)position < size && !termination_flag) {
+      TRYC_RETRY_ON_EINTR(
+        bytes_sent = sendfile(socket_fd, file_fd, &position, size - position));
+      AESDSOCKET_PROBE2(send__done, socket_fd, bytes_sent);
+      if (!bytes_sent)
+        break;
+    }
+  } else {
+    while ((uint64_t)position < end && !termination_flag) {
+      bytes_to_read = sizeof(buffer);
+      if (end - position < bytes_to_read)
+        bytes_to_read = end - position;
+
+      AESDSOCKET_PROBE1(lock__wait, MONITOR_PROFILE_READ);
+      monitor_start_reading(file_monitor);
+      AESDSOCKET_PROBE1(lock__acquired, MONITOR_PROFILE_READ);
+      bytes_read = read(file_fd, buffer, bytes_to_read);
+      monitor_stop_reading(file_monitor);
+      AESDSOCKET_PROBE1(lock__released, MONITOR_PROFILE_READ);
+      TRYC_CONTINUE_ON_EINTR(bytes_read);
+      AESDSOCKET_PROBE1(file__read, bytes_read);
+      if (!bytes_read)
+        break;
+      position += bytes_read;
 
-  while (!eof) {
-    TRY(
-      aesdsocket_read_line(file_fd, &line, &eof, file_monitor),
-      "line reading failed");
-    if (line && strlen(line)) {
-      TRY(aesdsocket_send_line(socket_fd, line), "line sending failed");
+      TRY(
+        aesdsocket_send_buffer(socket_fd, buffer, bytes_read),
+        "buffer sending failed");
     }
   }
 
   ok = true;
 
 done:
-  if (line)
-    free(line);
-
   return ok;
 }
 
+/* Replies PROTOCOL_ERROR_PREFIX, error and a newline. */
 bool
-aesdsocket_read_line(
-  int file_fd,
-  char **line,
-  bool *eof,
-  monitor_t *file_monitor)
+aesdsocket_send_error(int socket_fd, const char *error)
 {
   bool ok = false;
-  bool eol = false;
-  bool eof_local = false;
-  ssize_t bytes_read;
-  size_t line_buffer_size = 0;
-  char *line_buffer = NULL;
-  char buffer[BUFFSIZE] = "";
-
-  if (*line)
-    line_buffer = *line;
-
-  monitor_start_reading(file_monitor);
-  while (!eol && !eof_local) {
-    TRYC_RETRY_ON_EINTR(bytes_read = read(file_fd, buffer, BUFFSIZE));
-    if (bytes_read) {
-      ssize_t useful_bytes;
-      char *newline_pointer = NULL;
+  char reply[BUFFSIZE];
 
-      if ((newline_pointer = strchr(buffer, '\n')) != NULL) {
-        eol = true;
-        useful_bytes = newline_pointer - buffer + 1;
-      } else {
-        useful_bytes = bytes_read;
-      }
-
-      if (useful_bytes > 0) {
-        TRY_ERRNO(
-          line_buffer =
-            (char *)realloc(line_buffer, line_buffer_size + useful_bytes + 1));
-        strncpy(line_buffer + line_buffer_size, buffer, useful_bytes);
-        line_buffer_size += useful_bytes;
-      }
-    } else {
-      eof_local = true;
-    }
-  }
-  monitor_stop_reading(file_monitor);
-
-  if (line_buffer)
-    line_buffer[line_buffer_size] = '\0';
+  snprintf(reply, sizeof(reply), PROTOCOL_ERROR_PREFIX "%s\n", error);
+  TRY(aesdsocket_send_line(socket_fd, reply), "line sending failed");
 
   ok = true;
-  *line = line_buffer;
-  *eof = eof_local;
 
 done:
-  if (!ok && !(*line) && line_buffer)
-    free(line_buffer);
-
   return ok;
 }
 
 bool
-aesdsocket_send_line(int socket_fd, const char *line)
+aesdsocket_send_buffer(int socket_fd, const char *buffer, size_t size)
 {
   bool ok = false;
-  size_t bytes_to_send = strlen(line);
+  size_t bytes_to_send = size;
 
   while (bytes_to_send > 0 && !termination_flag) {
     ssize_t bytes_sent;
     TRYC_RETRY_ON_EINTR(
       bytes_sent =
-        send(socket_fd, line + strlen(line) - bytes_to_send, bytes_to_send, 0));
+        send(socket_fd, buffer + size - bytes_to_send, bytes_to_send, 0));
     bytes_to_send -= bytes_sent;
   }
+  AESDSOCKET_PROBE2(send__done, socket_fd, size - bytes_to_send);
 
   ok = true;
 
@@ -510,17 +903,26 @@ done:
   return ok;
 }
 
+bool
+aesdsocket_send_line(int socket_fd, const char *line)
+{
+  return aesdsocket_send_buffer(socket_fd, line, strlen(line));
+}
+
 bool
 aesdsocket_mainloop(
   const char *port,
   int backlog,
   const char *filename,
   bool is_regular_file,
+  const char *index_filename,
   bool daemon,
   bool use_timestamp,
   time_t timestamp_frequency_seconds,
   const char *timestamp_format,
-  const char *seekto_command)
+  const char *const command_names[AESDSOCKET_COMMAND_COUNT],
+  monitor_policy_t file_monitor_policy,
+  bool stamp_records)
 {
   bool ok = false;
   struct sigaction action;
@@ -532,8 +934,16 @@ aesdsocket_mainloop(
   queue_t *thread_queue = NULL;
   monitor_t *write_file_monitor = NULL;
   aesdsocket_thread_arg_t *thread_arg = NULL;
-  timer_t timestamp_timer = NULL;
-  struct itimerspec timestamp_frequency;
+  aesdsocket_timestamp_arg_t timestamp_arg = {
+    .timer_fd = -1,
+    .stop_fd = -1,
+    .file_fd = -1,
+  };
+  pthread_t timestamp_tid;
+  bool timestamp_started = false;
+  uint64_t record_sequence = 0;
+  record_index_t record_index = { .fd = -1 };
+  int index_data_fd = -1;
 
   if (daemon)
     TRY(aesdsocket_daemonize(), "daemonization failed");
@@ -546,43 +956,73 @@ aesdsocket_mainloop(
   TRYC_ERRNO(sigaction(SIGTERM, &action, NULL));
   TRYC_ERRNO(sigaction(SIGINT, &action, NULL));
 
+#ifdef MONITOR_PROFILE
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = aesdsocket_profile_dump_handler;
+  sigemptyset(&action.sa_mask);
+  TRYC_ERRNO(sigaddset(&action.sa_mask, SIGUSR1));
+  TRYC_ERRNO(sigaction(SIGUSR1, &action, NULL));
+#endif /* MONITOR_PROFILE */
+
   TRY(
     aesdsocket_open_listening_socket(&sockfd, port, backlog),
     "Couldn't open server socket");
 
   TRY(thread_queue = queue_new(), "queue creation failed");
-  TRY(write_file_monitor = monitor_new(), "monitor creation failed");
+  TRY(
+    write_file_monitor = monitor_new(file_monitor_policy),
+    "monitor creation failed");
+
+  if (index_filename) {
+    TRYC_ERRNO(
+      index_data_fd = open(
+        filename,
+        O_RDONLY | O_CREAT,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    TRY(
+      record_index_initialize(&record_index, index_filename, index_data_fd),
+      "record index initialization failed");
+    close(index_data_fd);
+    index_data_fd = -1;
+  }
 
   if (use_timestamp) {
-    memset(&action, 0, sizeof(action));
-    action.sa_handler = aesdsocket_timestamp_handler;
-    sigemptyset(&action.sa_mask);
-    TRYC_ERRNO(sigaddset(&action.sa_mask, SIGALRM));
-    TRYC_ERRNO(sigaction(SIGALRM, &action, NULL));
-
-    TRYC_ERRNO(timer_create(CLOCK_MONOTONIC, NULL, &timestamp_timer));
-
-    memset(&timestamp_frequency, 0, sizeof(timestamp_frequency));
-    timestamp_frequency.it_value.tv_sec = timestamp_frequency_seconds;
-    timestamp_frequency.it_interval.tv_sec = timestamp_frequency_seconds;
-    TRYC_ERRNO(timer_settime(timestamp_timer, 0, &timestamp_frequency, NULL));
+    TRYC_ERRNO(
+      timestamp_arg.file_fd = open(
+        filename,
+        O_WRONLY | O_APPEND | O_CREAT,
+        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    TRYC_ERRNO(
+      timestamp_arg.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    TRYC_ERRNO(timestamp_arg.stop_fd = eventfd(0, EFD_CLOEXEC));
+    TRY(
+      timestamp_formatter_initialize(
+        &timestamp_arg.formatter,
+        timestamp_format),
+      "timestamp formatter initialization failed");
+    timestamp_arg.file_monitor = write_file_monitor;
+    timestamp_arg.record_index = index_filename ? &record_index : NULL;
+
+    TRY(
+      timestamp_started = aesdsocket_start_timestamp_thread(
+        &timestamp_tid,
+        &timestamp_arg,
+        timestamp_frequency_seconds),
+      "timestamp thread creation failed");
   }
 
   while (!termination_flag) {
-    if (timestamp_flag) {
-      TRY(
-        aesdsocket_take_timestamp(
-          timestamp_format,
-          filename,
-          write_file_monitor),
-        "couldn't take timestamp");
-
-      timestamp_flag = 0;
+#ifdef MONITOR_PROFILE
+    if (profile_dump_flag) {
+      monitor_profile_dump();
+      profile_dump_flag = 0;
     }
+#endif /* MONITOR_PROFILE */
 
     TRYC_CONTINUE_ON_EINTR(
       conn_sockfd =
         accept(sockfd, (struct sockaddr *)&remote_addr, &addr_size));
+    AESDSOCKET_PROBE1(accept, conn_sockfd);
 
     const char *in_addr =
       aesdsocket_get_in_addr((struct sockaddr *)&remote_addr);
@@ -597,7 +1037,9 @@ aesdsocket_mainloop(
     TRY_ERRNO(thread_arg->filename = strdup(filename));
     TRY_ERRNO(thread_arg->remote_name = strndup(remote_name, INET6_ADDRSTRLEN));
     thread_arg->file_monitor = write_file_monitor;
-    thread_arg->seekto_command = seekto_command;
+    thread_arg->command_names = command_names;
+    thread_arg->record_sequence = stamp_records ? &record_sequence : NULL;
+    thread_arg->record_index = index_filename ? &record_index : NULL;
 
     pthread_t tid;
     int status;
@@ -609,8 +1051,24 @@ aesdsocket_mainloop(
   ok = true;
 
 done:
-  if (timestamp_timer)
-    timer_delete(timestamp_timer);
+  if (timestamp_started) {
+    uint64_t stop = 1;
+    int status;
+    if (write(timestamp_arg.stop_fd, &stop, sizeof(stop)) == -1)
+      LOG_ERROR(strerror(errno));
+    TRY_PTHREAD_JOIN_NOACTION(timestamp_tid, NULL, status);
+  }
+
+  if (timestamp_arg.stop_fd != -1)
+    close(timestamp_arg.stop_fd);
+
+  if (timestamp_arg.timer_fd != -1)
+    close(timestamp_arg.timer_fd);
+
+  if (timestamp_arg.file_fd != -1)
+    close(timestamp_arg.file_fd);
+
+  timestamp_formatter_finalize(&timestamp_arg.formatter);
 
   if (thread_queue) {
     while (!queue_is_empty(thread_queue)) {
@@ -624,6 +1082,14 @@ done:
   if (write_file_monitor)
     monitor_destroy(write_file_monitor);
 
+  if (index_data_fd != -1)
+    close(index_data_fd);
+
+  record_index_finalize(&record_index);
+
+  monitor_profile_dump();
+  monitor_profile_finalize();
+
   if (thread_arg) {
     if (thread_arg->filename)
       free(thread_arg->filename);
@@ -641,5 +1107,8 @@ done:
   if (is_regular_file)
     remove(filename);
 
+  if (index_filename)
+    remove(index_filename);
+
   return ok;
 }
@@ -0,0 +1,157 @@
+#include "aesdsocket_command.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct aesdsocket_command_spec
+{
+  unsigned argument_count;
+  /* Of every argument */
+  uint64_t maximum;
+};
+
+static const struct aesdsocket_command_spec
+  aesdsocket_command_specs[AESDSOCKET_COMMAND_COUNT] = {
+    [AESDSOCKET_COMMAND_SEEKTO] = { .argument_count = 2,
+                                    .maximum = UINT32_MAX },
+    [AESDSOCKET_COMMAND_READ_BYTES] = { .argument_count = 2,
+                                        .maximum = INT64_MAX },
+    [AESDSOCKET_COMMAND_READ_LAST] = { .argument_count = 1,
+                                       .maximum = INT64_MAX },
+    [AESDSOCKET_COMMAND_READ_SINCE] = { .argument_count = 1,
+                                        .maximum = INT64_MAX },
+  };
+
+static aesdsocket_command_type_t aesdsocket_command_match(
+  const char *const names[AESDSOCKET_COMMAND_COUNT],
+  const char *data,
+  size_t size,
+  size_t *name_length);
+static bool aesdsocket_command_parse_number(
+  const char **position,
+  const char *end,
+  uint64_t maximum,
+  uint64_t *value,
+  const char **error);
+
+/*
+ * Returns the type of the longest name data starts with, so that a name may
+ * be the prefix of another.
+ */
+aesdsocket_command_type_t
+aesdsocket_command_match(
+  const char *const names[AESDSOCKET_COMMAND_COUNT],
+  const char *data,
+  size_t size,
+  size_t *name_length)
+{
+  aesdsocket_command_type_t type = AESDSOCKET_COMMAND_NONE;
+  size_t length;
+
+  *name_length = 0;
+  for (int i = AESDSOCKET_COMMAND_NONE + 1; i < AESDSOCKET_COMMAND_COUNT; ++i) {
+    if (!names[i] || !*names[i])
+      continue;
+
+    length = strlen(names[i]);
+    if (
+      length <= size && length > *name_length &&
+      memcmp(data, names[i], length) == 0) {
+      type = i;
+      *name_length = length;
+    }
+  }
+
+  return type;
+}
+
+/* Reads at least one digit, up to end, and fails past maximum. */
+bool
+aesdsocket_command_parse_number(
+  const char **position,
+  const char *end,
+  uint64_t maximum,
+  uint64_t *value,
+  const char **error)
+{
+  const char *digit = *position;
+  uint64_t number = 0;
+
+  if (digit == end || *digit < '0' || *digit > '9') {
+    *error = "expected a decimal number";
+    return false;
+  }
+
+  for (; digit != end && *digit >= '0' && *digit <= '9'; ++digit) {
+    if (number > (maximum - (*digit - '0')) / 10) {
+      *error = "number out of range";
+      return false;
+    }
+    number = number * 10 + (*digit - '0');
+  }
+
+  *value = number;
+  *position = digit;
+
+  return true;
+}
+
+/*
+ * Parses the size bytes of data, a line with its newline, in one pass and
+ * without copying them. data needs no terminating NUL. Returns false with the
+ * reason in error if data is a malformed command, and true with the command,
+ * whose type is AESDSOCKET_COMMAND_NONE if data is not a command, otherwise.
+ */
+bool
+aesdsocket_command_parse(
+  const char *const names[AESDSOCKET_COMMAND_COUNT],
+  const char *data,
+  size_t size,
+  aesdsocket_command_t *command,
+  const char **error)
+{
+  const char *end = data + size;
+  const char *position;
+  size_t name_length;
+  const struct aesdsocket_command_spec *spec;
+
+  memset(command, 0, sizeof(aesdsocket_command_t));
+  command->type = aesdsocket_command_match(names, data, size, &name_length);
+  if (command->type == AESDSOCKET_COMMAND_NONE)
+    return true;
+
+  position = data + name_length;
+  if (position == end || *position != ':') {
+    *error = "expected ':' after the command";
+    return false;
+  }
+  ++position;
+
+  spec = &aesdsocket_command_specs[command->type];
+  for (unsigned i = 0; i < spec->argument_count; ++i) {
+    if (i > 0) {
+      if (position == end || *position != ',') {
+        *error = "expected ','";
+        return false;
+      }
+      ++position;
+    }
+
+    if (!aesdsocket_command_parse_number(
+          &position,
+          end,
+          spec->maximum,
+          &command->arguments[i],
+          error))
+      return false;
+  }
+
+  if (end - position != 1 || *position != '\n') {
+    *error = "expected the end of the line";
+    return false;
+  }
+
+  return true;
+}
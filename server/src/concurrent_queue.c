@@ -0,0 +1,250 @@
+#include "concurrent_queue.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "try.h"
+
+static void concurrent_queue_wait(
+  concurrent_queue_t *self,
+  uint32_t *event,
+  unsigned *waiters,
+  pthread_cond_t *cond,
+  uint32_t seen);
+static void concurrent_queue_wake(
+  concurrent_queue_t *self,
+  uint32_t *event,
+  unsigned *waiters,
+  pthread_cond_t *cond,
+  bool all);
+
+/*
+ * Sleeps until event moves past seen, which was read before the caller last
+ * found the ring full or empty. The waiter count is raised before event is
+ * read again and the waker reads it after bumping event, both sequentially
+ * consistent, so at least one of them sees the other.
+ */
+void
+concurrent_queue_wait(
+  concurrent_queue_t *self,
+  uint32_t *event,
+  unsigned *waiters,
+  pthread_cond_t *cond,
+  uint32_t seen)
+{
+  if (self->use_futex) {
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(event, __ATOMIC_SEQ_CST) == seen)
+      syscall(SYS_futex, event, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+  } else {
+    pthread_mutex_lock(&self->lock);
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(event, __ATOMIC_SEQ_CST) == seen)
+      pthread_cond_wait(cond, &self->lock);
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&self->lock);
+  }
+}
+
+/* Only makes a system call or takes the lock when someone is waiting. */
+void
+concurrent_queue_wake(
+  concurrent_queue_t *self,
+  uint32_t *event,
+  unsigned *waiters,
+  pthread_cond_t *cond,
+  bool all)
+{
+  __atomic_add_fetch(event, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(waiters, __ATOMIC_SEQ_CST))
+    return;
+
+  if (self->use_futex) {
+    syscall(
+      SYS_futex,
+      event,
+      FUTEX_WAKE_PRIVATE,
+      all ? INT_MAX : 1,
+      NULL,
+      NULL,
+      0);
+  } else {
+    pthread_mutex_lock(&self->lock);
+    if (all)
+      pthread_cond_broadcast(cond);
+    else
+      pthread_cond_signal(cond);
+    pthread_mutex_unlock(&self->lock);
+  }
+}
+
+bool
+concurrent_queue_initialize(concurrent_queue_t *self, bool use_futex)
+{
+  memset(self, 0, sizeof(concurrent_queue_t));
+  tid_mpmc_ring_init(&self->ring);
+  self->use_futex = use_futex;
+
+  pthread_mutex_init(&self->lock, NULL);
+  pthread_cond_init(&self->can_enqueue, NULL);
+  pthread_cond_init(&self->can_dequeue, NULL);
+
+  return true;
+}
+
+void
+concurrent_queue_finalize(concurrent_queue_t *self)
+{
+  pthread_mutex_destroy(&self->lock);
+  pthread_cond_destroy(&self->can_enqueue);
+  pthread_cond_destroy(&self->can_dequeue);
+}
+
+/* The ring counters sit on their own cache lines, hence aligned_alloc. */
+concurrent_queue_t *
+concurrent_queue_new(bool use_futex)
+{
+  concurrent_queue_t *new_object = NULL;
+  concurrent_queue_t *object = NULL;
+
+  TRY_ERRNO(
+    new_object = aligned_alloc(
+      AESD_RING_CACHELINE_SIZE,
+      sizeof(concurrent_queue_t)));
+  TRY(
+    concurrent_queue_initialize(new_object, use_futex),
+    "concurrent queue initialization failed");
+
+  object = new_object;
+
+done:
+  if (!object && new_object)
+    free(new_object);
+
+  return object;
+}
+
+void
+concurrent_queue_destroy(concurrent_queue_t *self)
+{
+  concurrent_queue_finalize(self);
+  free(self);
+}
+
+/* Only a snapshot while other threads use the queue. */
+size_t
+concurrent_queue_size(const concurrent_queue_t *self)
+{
+  return tid_mpmc_ring_count(&self->ring);
+}
+
+bool
+concurrent_queue_try_enqueue(concurrent_queue_t *self, pthread_t tid)
+{
+  if (!tid_mpmc_ring_push(&self->ring, &tid))
+    return false;
+
+  concurrent_queue_wake(
+    self,
+    &self->not_empty,
+    &self->empty_waiters,
+    &self->can_dequeue,
+    false);
+
+  return true;
+}
+
+bool
+concurrent_queue_try_dequeue(concurrent_queue_t *self, pthread_t *tid)
+{
+  if (!tid_mpmc_ring_pop(&self->ring, tid))
+    return false;
+
+  concurrent_queue_wake(
+    self,
+    &self->not_full,
+    &self->full_waiters,
+    &self->can_enqueue,
+    false);
+
+  return true;
+}
+
+/* Waits while the queue is full. Fails once the queue is closed. */
+bool
+concurrent_queue_enqueue(concurrent_queue_t *self, pthread_t tid)
+{
+  uint32_t seen;
+
+  for (;;) {
+    seen = __atomic_load_n(&self->not_full, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&self->closed, __ATOMIC_ACQUIRE))
+      return false;
+    if (concurrent_queue_try_enqueue(self, tid))
+      return true;
+
+    concurrent_queue_wait(
+      self,
+      &self->not_full,
+      &self->full_waiters,
+      &self->can_enqueue,
+      seen);
+  }
+}
+
+/*
+ * Waits while the queue is empty. Once the queue is closed, the remaining
+ * tids can still be dequeued, then it fails.
+ */
+bool
+concurrent_queue_dequeue(concurrent_queue_t *self, pthread_t *tid)
+{
+  uint32_t seen;
+
+  for (;;) {
+    seen = __atomic_load_n(&self->not_empty, __ATOMIC_SEQ_CST);
+    if (concurrent_queue_try_dequeue(self, tid))
+      return true;
+    if (__atomic_load_n(&self->closed, __ATOMIC_ACQUIRE))
+      return concurrent_queue_try_dequeue(self, tid);
+
+    concurrent_queue_wait(
+      self,
+      &self->not_empty,
+      &self->empty_waiters,
+      &self->can_dequeue,
+      seen);
+  }
+}
+
+/*
+ * Wakes every blocked caller. Enqueues started before the close may still
+ * complete, so consumers should only rely on the close once every producer
+ * has returned.
+ */
+void
+concurrent_queue_close(concurrent_queue_t *self)
+{
+  __atomic_store_n(&self->closed, true, __ATOMIC_RELEASE);
+
+  concurrent_queue_wake(
+    self,
+    &self->not_full,
+    &self->full_waiters,
+    &self->can_enqueue,
+    true);
+  concurrent_queue_wake(
+    self,
+    &self->not_empty,
+    &self->empty_waiters,
+    &self->can_dequeue,
+    true);
+}
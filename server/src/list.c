@@ -0,0 +1,218 @@
+#include "list.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+static void list_clear(list_t *self);
+static list_link_t *list_get_from_head(const list_t *self, size_t pos);
+static list_link_t *list_get_from_tail(const list_t *self, size_t pos);
+static void list_insert_when_empty(list_t *self, list_link_t *link);
+static void list_insert_before(
+  list_t *self,
+  list_link_t *next,
+  list_link_t *link);
+
+void
+list_clear(list_t *self)
+{
+  memset(self, 0, sizeof(list_t));
+}
+
+list_link_t *
+list_get_from_head(const list_t *self, size_t pos)
+{
+  assert(pos < list_size(self));
+
+  list_link_t *current = self->head;
+  for (size_t i = 0; i < pos; ++i)
+    current = current->next;
+
+  return current;
+}
+
+list_link_t *
+list_get_from_tail(const list_t *self, size_t pos)
+{
+  assert(pos < list_size(self));
+
+  list_link_t *current = self->tail;
+  for (size_t i = list_size(self) - 1; i > pos; --i)
+    current = current->prev;
+
+  return current;
+}
+
+void
+list_insert_when_empty(list_t *self, list_link_t *link)
+{
+  assert(list_is_empty(self));
+
+  link->next = NULL;
+  link->prev = NULL;
+  self->head = link;
+  self->tail = link;
+  self->size = 1;
+}
+
+/* next is the link that will follow the new one, NULL to append. */
+void
+list_insert_before(list_t *self, list_link_t *next, list_link_t *link)
+{
+  assert(!list_is_empty(self));
+
+  link->next = next;
+  link->prev = next ? next->prev : self->tail;
+
+  if (link->prev)
+    link->prev->next = link;
+  else
+    self->head = link;
+
+  if (next)
+    next->prev = link;
+  else
+    self->tail = link;
+
+  ++self->size;
+}
+
+bool
+list_initialize(list_t *self)
+{
+  list_clear(self);
+  return true;
+}
+
+/* The payloads belong to the caller, who must have removed them. */
+void
+list_finalize(list_t *self)
+{
+  assert(list_is_empty(self));
+}
+
+size_t
+list_size(const list_t *self)
+{
+  return self->size;
+}
+
+bool
+list_is_empty(const list_t *self)
+{
+  return list_size(self) == 0;
+}
+
+/* Walks from whichever end is closer. */
+list_link_t *
+list_get(const list_t *self, size_t pos)
+{
+  assert(pos < list_size(self));
+
+  if (pos < list_size(self) / 2)
+    return list_get_from_head(self, pos);
+  else
+    return list_get_from_tail(self, pos);
+}
+
+list_link_t *
+list_get_head(const list_t *self)
+{
+  assert(!list_is_empty(self));
+
+  return self->head;
+}
+
+list_link_t *
+list_get_tail(const list_t *self)
+{
+  assert(!list_is_empty(self));
+
+  return self->tail;
+}
+
+void
+list_insert(list_t *self, size_t pos, list_link_t *link)
+{
+  assert(pos <= list_size(self));
+
+  if (list_is_empty(self))
+    list_insert_when_empty(self, link);
+  else if (pos == list_size(self))
+    list_insert_before(self, NULL, link);
+  else
+    list_insert_before(self, list_get(self, pos), link);
+}
+
+void
+list_insert_head(list_t *self, list_link_t *link)
+{
+  if (list_is_empty(self))
+    list_insert_when_empty(self, link);
+  else
+    list_insert_before(self, self->head, link);
+}
+
+void
+list_insert_tail(list_t *self, list_link_t *link)
+{
+  if (list_is_empty(self))
+    list_insert_when_empty(self, link);
+  else
+    list_insert_before(self, NULL, link);
+}
+
+list_link_t *
+list_remove(list_t *self, size_t pos)
+{
+  assert(pos < list_size(self));
+
+  list_link_t *link = list_get(self, pos);
+  list_unlink(self, link);
+
+  return link;
+}
+
+list_link_t *
+list_remove_head(list_t *self)
+{
+  assert(!list_is_empty(self));
+
+  list_link_t *link = self->head;
+  list_unlink(self, link);
+
+  return link;
+}
+
+list_link_t *
+list_remove_tail(list_t *self)
+{
+  assert(!list_is_empty(self));
+
+  list_link_t *link = self->tail;
+  list_unlink(self, link);
+
+  return link;
+}
+
+/* link must currently be in the list. */
+void
+list_unlink(list_t *self, list_link_t *link)
+{
+  assert(!list_is_empty(self));
+
+  if (link->prev)
+    link->prev->next = link->next;
+  else
+    self->head = link->next;
+
+  if (link->next)
+    link->next->prev = link->prev;
+  else
+    self->tail = link->prev;
+
+  link->next = NULL;
+  link->prev = NULL;
+  --self->size;
+}
@@ -6,6 +6,8 @@
 #include <unistd.h>
 
 #include "aesdsocket.h"
+#include "aesdsocket_command.h"
+#include "monitor.h"
 #include "queue.h"
 #include "try.h"
 
@@ -14,15 +16,36 @@
 #ifdef USE_AESD_CHAR_DEVICE
 #define FILENAME "/dev/aesdchar"
 #define ISREGULAR false
+/* The device keeps its own records */
+#define INDEXFILENAME NULL
 #define USESTAMP false
 #else
 #define FILENAME "/var/tmp/aesdsocketdata"
 #define ISREGULAR true
+/* Start offsets of the records, for AESDCHAR_IOCSEEKTO */
+#define INDEXFILENAME "/var/tmp/aesdsocketdata.index"
 #define USESTAMP true
 #endif /* USE_AESD_CHAR_DEVICE */
 #define STAMPFREQSEC 10
 #define STAMPFORMAT "timestamp:%a, %d %b %Y %T %z"
 #define SEEKTO_COMMAND "AESDCHAR_IOCSEEKTO"
+#define READBYTES_COMMAND "AESDSOCKET_READBYTES"
+#define READLAST_COMMAND "AESDSOCKET_READLAST"
+#define READSINCE_COMMAND "AESDSOCKET_READSINCE"
+#define FILE_MONITOR_POLICY MONITOR_PHASE_FAIR
+/* Prefixes every record with "seq=<n> recv=<seconds>.<nanoseconds> " */
+#ifdef STAMP_RECORDS
+#define STAMPRECORDS true
+#else
+#define STAMPRECORDS false
+#endif /* STAMP_RECORDS */
+
+static const char *const command_names[AESDSOCKET_COMMAND_COUNT] = {
+  [AESDSOCKET_COMMAND_SEEKTO] = SEEKTO_COMMAND,
+  [AESDSOCKET_COMMAND_READ_BYTES] = READBYTES_COMMAND,
+  [AESDSOCKET_COMMAND_READ_LAST] = READLAST_COMMAND,
+  [AESDSOCKET_COMMAND_READ_SINCE] = READSINCE_COMMAND,
+};
 
 int
 main(int argc, char *argv[])
@@ -47,11 +70,14 @@ main(int argc, char *argv[])
       BACKLOG,
       FILENAME,
       ISREGULAR,
+      INDEXFILENAME,
       daemon,
       USESTAMP,
       STAMPFREQSEC,
       STAMPFORMAT,
-      SEEKTO_COMMAND),
+      command_names,
+      FILE_MONITOR_POLICY,
+      STAMPRECORDS),
     "execution failed");
 
   exit_status = EXIT_SUCCESS;
@@ -1,13 +1,50 @@
 #include "monitor.h"
 
+#include <assert.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "list.h"
+#include "monitor_profile.h"
 #include "try.h"
 
+/* Lives on the stack of a waiting writer. */
+struct monitor_writer
+{
+  list_link_t link;
+  pthread_cond_t can_write;
+};
+
 static void monitor_clear(monitor_t *self);
+static uint64_t monitor_now_ns(void);
+static void monitor_cond_init(pthread_cond_t *cond);
+static bool monitor_wait(
+  monitor_t *self,
+  pthread_cond_t *cond,
+  const struct timespec *deadline);
+static bool monitor_reader_can_enter(const monitor_t *self);
+static bool monitor_writer_can_enter(
+  const monitor_t *self,
+  const struct monitor_writer *writer);
+static void monitor_wake(monitor_t *self);
+static void monitor_record_queue_depth(monitor_t *self);
+static void monitor_record_wait(
+  monitor_t *self,
+  uint64_t start_ns,
+  uint64_t *total_ns);
+static bool monitor_acquire_read(
+  monitor_t *self,
+  bool wait,
+  const struct timespec *deadline);
+static bool monitor_acquire_write(
+  monitor_t *self,
+  bool wait,
+  const struct timespec *deadline);
 
 void
 monitor_clear(monitor_t *self)
@@ -15,13 +52,236 @@ monitor_clear(monitor_t *self)
   memset(self, 0, sizeof(monitor_t));
 }
 
+uint64_t
+monitor_now_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Timed waits take CLOCK_MONOTONIC deadlines. */
+void
+monitor_cond_init(pthread_cond_t *cond)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/* Returns false once deadline has passed. Waits forever without one. */
+bool
+monitor_wait(
+  monitor_t *self,
+  pthread_cond_t *cond,
+  const struct timespec *deadline)
+{
+  if (!deadline) {
+    pthread_cond_wait(cond, &self->condition_lock);
+    return true;
+  }
+
+  return pthread_cond_timedwait(cond, &self->condition_lock, deadline) !=
+         ETIMEDOUT;
+}
+
+bool
+monitor_reader_can_enter(const monitor_t *self)
+{
+  if (self->active_writers)
+    return false;
+
+  return self->policy == MONITOR_PREFER_READERS ||
+         list_is_empty(&self->waiting_writers);
+}
+
+/* writer is NULL for a writer that has not queued. */
+bool
+monitor_writer_can_enter(
+  const monitor_t *self,
+  const struct monitor_writer *writer)
+{
+  const list_link_t *first = NULL;
+
+  if (self->active_writers || self->active_readers)
+    return false;
+
+  if (!list_is_empty(&self->waiting_writers))
+    first = list_get_head(&self->waiting_writers);
+  if (first != (writer ? &writer->link : NULL))
+    return false;
+
+  switch (self->policy) {
+    case MONITOR_PREFER_READERS:
+      return self->waiting_readers == 0;
+    case MONITOR_PHASE_FAIR:
+      return self->admitted_readers == 0;
+    default:
+      return true;
+  }
+}
+
+/* Wakes whoever may go in now. Must be called with condition_lock held. */
+void
+monitor_wake(monitor_t *self)
+{
+  struct monitor_writer *first;
+
+  if (
+    self->admitted_readers ||
+    (self->waiting_readers && monitor_reader_can_enter(self)))
+    pthread_cond_broadcast(&self->can_read);
+
+  if (!list_is_empty(&self->waiting_writers)) {
+    first = LIST_ENTRY(
+      list_get_head(&self->waiting_writers),
+      struct monitor_writer,
+      link);
+    if (monitor_writer_can_enter(self, first))
+      pthread_cond_signal(&first->can_write);
+  }
+}
+
+void
+monitor_record_queue_depth(monitor_t *self)
+{
+  unsigned depth = self->waiting_readers + list_size(&self->waiting_writers);
+
+  if (depth > self->stats.max_queue_depth)
+    self->stats.max_queue_depth = depth;
+}
+
+void
+monitor_record_wait(monitor_t *self, uint64_t start_ns, uint64_t *total_ns)
+{
+  uint64_t wait_ns = monitor_now_ns() - start_ns;
+
+  *total_ns += wait_ns;
+  if (wait_ns > self->stats.max_wait_ns)
+    self->stats.max_wait_ns = wait_ns;
+}
+
+bool
+monitor_acquire_read(
+  monitor_t *self,
+  bool wait,
+  const struct timespec *deadline)
+{
+  bool entered;
+  bool admitted = false;
+  bool timed_out = false;
+  uint64_t phase;
+  uint64_t start_ns;
+  uint64_t arrival = monitor_profile_now();
+
+  pthread_mutex_lock(&self->condition_lock);
+
+  entered = monitor_reader_can_enter(self);
+  if (!entered && wait) {
+    ++self->stats.contended_reads;
+    ++self->waiting_readers;
+    monitor_record_queue_depth(self);
+    phase = self->phase;
+    start_ns = monitor_now_ns();
+
+    for (;;) {
+      admitted =
+        self->policy == MONITOR_PHASE_FAIR && self->phase != phase;
+      entered = admitted || monitor_reader_can_enter(self);
+      if (entered || timed_out)
+        break;
+      timed_out = !monitor_wait(self, &self->can_read, deadline);
+    }
+
+    monitor_record_wait(self, start_ns, &self->stats.read_wait_ns);
+    --self->waiting_readers;
+    if (admitted)
+      --self->admitted_readers;
+    if (!entered)
+      monitor_wake(self);
+  }
+
+  if (entered) {
+    if (self->active_readers++ == 0)
+      self->read_start_ns = monitor_now_ns();
+    ++self->stats.reads;
+  } else {
+    ++self->stats.failed_acquisitions;
+  }
+
+  pthread_mutex_unlock(&self->condition_lock);
+
+  if (entered)
+    monitor_profile_acquired(MONITOR_PROFILE_READ, arrival);
+
+  return entered;
+}
+
+bool
+monitor_acquire_write(
+  monitor_t *self,
+  bool wait,
+  const struct timespec *deadline)
+{
+  bool entered;
+  bool timed_out = false;
+  struct monitor_writer writer;
+  uint64_t start_ns;
+  uint64_t arrival = monitor_profile_now();
+
+  pthread_mutex_lock(&self->condition_lock);
+
+  entered = monitor_writer_can_enter(self, NULL);
+  if (!entered && wait) {
+    ++self->stats.contended_writes;
+    monitor_cond_init(&writer.can_write);
+    list_insert_tail(&self->waiting_writers, &writer.link);
+    monitor_record_queue_depth(self);
+    start_ns = monitor_now_ns();
+
+    for (;;) {
+      entered = monitor_writer_can_enter(self, &writer);
+      if (entered || timed_out)
+        break;
+      timed_out = !monitor_wait(self, &writer.can_write, deadline);
+    }
+
+    monitor_record_wait(self, start_ns, &self->stats.write_wait_ns);
+    list_unlink(&self->waiting_writers, &writer.link);
+    pthread_cond_destroy(&writer.can_write);
+    if (!entered)
+      monitor_wake(self);
+  }
+
+  if (entered) {
+    self->active_writers = 1;
+    self->write_start_ns = monitor_now_ns();
+    ++self->stats.writes;
+  } else {
+    ++self->stats.failed_acquisitions;
+  }
+
+  pthread_mutex_unlock(&self->condition_lock);
+
+  if (entered)
+    monitor_profile_acquired(MONITOR_PROFILE_WRITE, arrival);
+
+  return entered;
+}
+
 bool
-monitor_initialize(monitor_t *self)
+monitor_initialize(monitor_t *self, monitor_policy_t policy)
 {
   monitor_clear(self);
+  self->policy = policy;
+  list_initialize(&self->waiting_writers);
 
-  pthread_cond_init(&self->can_read, NULL);
-  pthread_cond_init(&self->can_write, NULL);
+  monitor_cond_init(&self->can_read);
   pthread_mutex_init(&self->condition_lock, NULL);
 
   return true;
@@ -30,19 +290,19 @@ monitor_initialize(monitor_t *self)
 void
 monitor_finalize(monitor_t *self)
 {
+  list_finalize(&self->waiting_writers);
   pthread_cond_destroy(&self->can_read);
-  pthread_cond_destroy(&self->can_write);
   pthread_mutex_destroy(&self->condition_lock);
 }
 
 monitor_t *
-monitor_new(void)
+monitor_new(monitor_policy_t policy)
 {
   monitor_t *new_object = NULL;
   monitor_t *object = NULL;
 
   TRY_ALLOCATE(new_object, monitor_t);
-  TRY(monitor_initialize(new_object), "monitor initalization failed");
+  TRY(monitor_initialize(new_object, policy), "monitor initalization failed");
 
   object = new_object;
 
@@ -63,51 +323,84 @@ monitor_destroy(monitor_t *self)
 void
 monitor_start_reading(monitor_t *self)
 {
-  pthread_mutex_lock(&self->condition_lock);
-  if (self->active_writers || self->waiting_writers) {
-    ++self->waiting_readers;
-    pthread_cond_wait(&self->can_read, &self->condition_lock);
-    --self->waiting_readers;
-  }
-  ++self->active_readers;
-  pthread_mutex_unlock(&self->condition_lock);
-
-  pthread_cond_broadcast(&self->can_read);
+  monitor_acquire_read(self, true, NULL);
 }
 
 void
 monitor_stop_reading(monitor_t *self)
 {
+  monitor_profile_released(MONITOR_PROFILE_READ);
+
   pthread_mutex_lock(&self->condition_lock);
-  if (--self->active_readers == 0)
-    pthread_cond_broadcast(&self->can_write);
+  assert(self->active_readers > 0);
+  if (--self->active_readers == 0) {
+    self->stats.read_hold_ns += monitor_now_ns() - self->read_start_ns;
+    monitor_wake(self);
+  }
   pthread_mutex_unlock(&self->condition_lock);
 }
 
 void
 monitor_start_writing(monitor_t *self)
 {
+  monitor_acquire_write(self, true, NULL);
+}
+
+/* Under MONITOR_PHASE_FAIR, lets in every reader waiting at this point. */
+void
+monitor_stop_writing(monitor_t *self)
+{
+  uint64_t hold_ns;
+
+  monitor_profile_released(MONITOR_PROFILE_WRITE);
+
   pthread_mutex_lock(&self->condition_lock);
-  if (
-    self->active_writers || self->active_readers || self->waiting_readers ||
-    self->waiting_writers) {
-    ++self->waiting_writers;
-    pthread_cond_wait(&self->can_write, &self->condition_lock);
-    --self->waiting_writers;
+  assert(self->active_writers == 1);
+  self->active_writers = 0;
+
+  hold_ns = monitor_now_ns() - self->write_start_ns;
+  self->stats.write_hold_ns += hold_ns;
+  if (hold_ns > self->stats.max_write_hold_ns)
+    self->stats.max_write_hold_ns = hold_ns;
+
+  if (self->policy == MONITOR_PHASE_FAIR) {
+    assert(self->admitted_readers == 0);
+    self->admitted_readers = self->waiting_readers;
+    ++self->phase;
   }
-  ++self->active_writers;
+
+  monitor_wake(self);
   pthread_mutex_unlock(&self->condition_lock);
 }
 
+bool
+monitor_try_start_reading(monitor_t *self)
+{
+  return monitor_acquire_read(self, false, NULL);
+}
+
+bool
+monitor_try_start_writing(monitor_t *self)
+{
+  return monitor_acquire_write(self, false, NULL);
+}
+
+bool
+monitor_timed_start_reading(monitor_t *self, const struct timespec *deadline)
+{
+  return monitor_acquire_read(self, true, deadline);
+}
+
+bool
+monitor_timed_start_writing(monitor_t *self, const struct timespec *deadline)
+{
+  return monitor_acquire_write(self, true, deadline);
+}
+
 void
-monitor_stop_writing(monitor_t *self)
+monitor_get_stats(monitor_t *self, monitor_stats_t *stats)
 {
   pthread_mutex_lock(&self->condition_lock);
-  if (--self->active_writers == 0) {
-    if (self->waiting_readers)
-      pthread_cond_broadcast(&self->can_read);
-    else if (self->waiting_writers)
-      pthread_cond_broadcast(&self->can_write);
-  }
+  *stats = self->stats;
   pthread_mutex_unlock(&self->condition_lock);
 }
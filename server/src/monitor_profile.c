@@ -0,0 +1,357 @@
+#include "monitor_profile.h"
+
+#ifdef MONITOR_PROFILE
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MONITOR_PROFILE_USE_TSC
+#endif
+
+/* Bucket i counts the durations whose bit length is i */
+#define MONITOR_PROFILE_BUCKETS 65
+
+enum monitor_profile_metric
+{
+  MONITOR_PROFILE_WAIT,
+  MONITOR_PROFILE_HOLD,
+  MONITOR_PROFILE_METRICS,
+};
+
+/* Only the owning thread writes, monitor_profile_dump reads concurrently. */
+struct monitor_profile_histogram
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t buckets[MONITOR_PROFILE_BUCKETS];
+};
+
+struct monitor_profile_thread
+{
+  struct monitor_profile_thread *next;
+  pid_t tid;
+  uint64_t hold_start[MONITOR_PROFILE_MODES];
+  struct monitor_profile_histogram histograms[MONITOR_PROFILE_MODES]
+                                             [MONITOR_PROFILE_METRICS];
+};
+
+static const char *const monitor_profile_mode_names[] = { "read", "write" };
+static const char *const monitor_profile_metric_names[] = { "wait", "hold" };
+
+static pthread_mutex_t monitor_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct monitor_profile_thread *monitor_profile_threads = NULL;
+/* Histograms of the threads that have exited, merged */
+static struct monitor_profile_thread monitor_profile_exited;
+static uint64_t monitor_profile_start_ticks;
+static uint64_t monitor_profile_start_ns;
+
+static pthread_once_t monitor_profile_once = PTHREAD_ONCE_INIT;
+static pthread_key_t monitor_profile_key;
+static __thread struct monitor_profile_thread *monitor_profile_self = NULL;
+
+static uint64_t monitor_profile_raw_ns(void);
+static void monitor_profile_setup(void);
+static void monitor_profile_thread_exit(void *arg);
+static struct monitor_profile_thread *monitor_profile_register(void);
+static void monitor_profile_add(
+  struct monitor_profile_histogram *histogram,
+  uint64_t ticks);
+static void monitor_profile_merge(
+  struct monitor_profile_thread *into,
+  const struct monitor_profile_thread *from);
+static double monitor_profile_ns_per_tick(void);
+static double monitor_profile_percentile(
+  const struct monitor_profile_histogram *histogram,
+  double fraction,
+  double ns_per_tick);
+static void monitor_profile_log(
+  const char *owner,
+  const struct monitor_profile_thread *thread,
+  double ns_per_tick);
+
+uint64_t
+monitor_profile_raw_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void
+monitor_profile_setup(void)
+{
+  pthread_key_create(&monitor_profile_key, monitor_profile_thread_exit);
+  monitor_profile_start_ns = monitor_profile_raw_ns();
+  monitor_profile_start_ticks = monitor_profile_now();
+}
+
+/* Folds the histograms of an exiting thread in monitor_profile_exited. */
+void
+monitor_profile_thread_exit(void *arg)
+{
+  struct monitor_profile_thread *thread = arg;
+  struct monitor_profile_thread **link;
+
+  pthread_mutex_lock(&monitor_profile_lock);
+  for (link = &monitor_profile_threads; *link; link = &(*link)->next) {
+    if (*link == thread) {
+      *link = thread->next;
+      break;
+    }
+  }
+  monitor_profile_merge(&monitor_profile_exited, thread);
+  pthread_mutex_unlock(&monitor_profile_lock);
+
+  monitor_profile_self = NULL;
+  free(thread);
+}
+
+struct monitor_profile_thread *
+monitor_profile_register(void)
+{
+  struct monitor_profile_thread *thread;
+
+  pthread_once(&monitor_profile_once, monitor_profile_setup);
+
+  if (!(thread = calloc(1, sizeof(struct monitor_profile_thread))))
+    return NULL;
+  thread->tid = syscall(SYS_gettid);
+  pthread_setspecific(monitor_profile_key, thread);
+
+  pthread_mutex_lock(&monitor_profile_lock);
+  thread->next = monitor_profile_threads;
+  monitor_profile_threads = thread;
+  pthread_mutex_unlock(&monitor_profile_lock);
+
+  return thread;
+}
+
+void
+monitor_profile_add(struct monitor_profile_histogram *histogram, uint64_t ticks)
+{
+  unsigned bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+
+  __atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&histogram->sum, histogram->sum + ticks, __ATOMIC_RELAXED);
+  if (ticks > histogram->max)
+    __atomic_store_n(&histogram->max, ticks, __ATOMIC_RELAXED);
+  __atomic_store_n(
+    &histogram->buckets[bucket],
+    histogram->buckets[bucket] + 1,
+    __ATOMIC_RELAXED);
+}
+
+/* Must be called with monitor_profile_lock held. */
+void
+monitor_profile_merge(
+  struct monitor_profile_thread *into,
+  const struct monitor_profile_thread *from)
+{
+  const struct monitor_profile_histogram *source;
+  struct monitor_profile_histogram *target;
+  uint64_t max;
+
+  for (int mode = 0; mode < MONITOR_PROFILE_MODES; ++mode) {
+    for (int metric = 0; metric < MONITOR_PROFILE_METRICS; ++metric) {
+      source = &from->histograms[mode][metric];
+      target = &into->histograms[mode][metric];
+
+      target->count += __atomic_load_n(&source->count, __ATOMIC_RELAXED);
+      target->sum += __atomic_load_n(&source->sum, __ATOMIC_RELAXED);
+      max = __atomic_load_n(&source->max, __ATOMIC_RELAXED);
+      if (max > target->max)
+        target->max = max;
+      for (int i = 0; i < MONITOR_PROFILE_BUCKETS; ++i)
+        target->buckets[i] +=
+          __atomic_load_n(&source->buckets[i], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/* The TSC rate is measured against CLOCK_MONOTONIC_RAW since startup. */
+double
+monitor_profile_ns_per_tick(void)
+{
+#ifdef MONITOR_PROFILE_USE_TSC
+  uint64_t ticks = monitor_profile_now() - monitor_profile_start_ticks;
+  uint64_t ns = monitor_profile_raw_ns() - monitor_profile_start_ns;
+
+  return ticks ? (double)ns / ticks : 1.0;
+#else
+  return 1.0;
+#endif
+}
+
+/*
+ * Upper bound of the bucket holding the given fraction of the samples, at most
+ * the largest sample.
+ */
+double
+monitor_profile_percentile(
+  const struct monitor_profile_histogram *histogram,
+  double fraction,
+  double ns_per_tick)
+{
+  uint64_t rank = (uint64_t)(fraction * histogram->count);
+  uint64_t seen = 0;
+  uint64_t bound = histogram->max;
+  int bucket = 0;
+
+  for (; bucket < MONITOR_PROFILE_BUCKETS - 1; ++bucket) {
+    seen += histogram->buckets[bucket];
+    if (seen > rank)
+      break;
+  }
+
+  if (
+    bucket < MONITOR_PROFILE_BUCKETS - 1 &&
+    (UINT64_C(1) << bucket) - 1 < bound)
+    bound = (UINT64_C(1) << bucket) - 1;
+
+  return bound * ns_per_tick;
+}
+
+void
+monitor_profile_log(
+  const char *owner,
+  const struct monitor_profile_thread *thread,
+  double ns_per_tick)
+{
+  const struct monitor_profile_histogram *histogram;
+
+  for (int mode = 0; mode < MONITOR_PROFILE_MODES; ++mode) {
+    for (int metric = 0; metric < MONITOR_PROFILE_METRICS; ++metric) {
+      histogram = &thread->histograms[mode][metric];
+      if (!histogram->count)
+        continue;
+
+      syslog(
+        LOG_INFO,
+        "monitor profile: %s %s %s: count=%" PRIu64 " mean=%.0fns "
+        "p50<=%.0fns p99<=%.0fns p999<=%.0fns max=%.0fns\n",
+        owner,
+        monitor_profile_mode_names[mode],
+        monitor_profile_metric_names[metric],
+        histogram->count,
+        (double)histogram->sum / histogram->count * ns_per_tick,
+        monitor_profile_percentile(histogram, 0.5, ns_per_tick),
+        monitor_profile_percentile(histogram, 0.99, ns_per_tick),
+        monitor_profile_percentile(histogram, 0.999, ns_per_tick),
+        histogram->max * ns_per_tick);
+    }
+  }
+}
+
+/* rdtsc where available, CLOCK_MONOTONIC_RAW nanoseconds otherwise. */
+uint64_t
+monitor_profile_now(void)
+{
+#ifdef MONITOR_PROFILE_USE_TSC
+  return __rdtsc();
+#else
+  return monitor_profile_raw_ns();
+#endif
+}
+
+void
+monitor_profile_acquired(monitor_profile_mode_t mode, uint64_t arrival)
+{
+  struct monitor_profile_thread *thread = monitor_profile_self;
+  uint64_t now = monitor_profile_now();
+
+  if (!thread && !(thread = monitor_profile_self = monitor_profile_register()))
+    return;
+
+  monitor_profile_add(
+    &thread->histograms[mode][MONITOR_PROFILE_WAIT],
+    now - arrival);
+  thread->hold_start[mode] = now;
+}
+
+/* Assumes a thread holds at most one monitor in each mode at a time. */
+void
+monitor_profile_released(monitor_profile_mode_t mode)
+{
+  struct monitor_profile_thread *thread = monitor_profile_self;
+
+  if (!thread)
+    return;
+
+  monitor_profile_add(
+    &thread->histograms[mode][MONITOR_PROFILE_HOLD],
+    monitor_profile_now() - thread->hold_start[mode]);
+}
+
+/*
+ * Logs one line per thread, mode and metric, then the totals over every
+ * thread, exited ones included.
+ */
+void
+monitor_profile_dump(void)
+{
+  struct monitor_profile_thread total;
+  struct monitor_profile_thread *thread;
+  double ns_per_tick;
+  char owner[32];
+
+  pthread_once(&monitor_profile_once, monitor_profile_setup);
+  ns_per_tick = monitor_profile_ns_per_tick();
+  memset(&total, 0, sizeof(struct monitor_profile_thread));
+
+  pthread_mutex_lock(&monitor_profile_lock);
+
+  for (thread = monitor_profile_threads; thread; thread = thread->next) {
+    struct monitor_profile_thread snapshot;
+
+    memset(&snapshot, 0, sizeof(struct monitor_profile_thread));
+    monitor_profile_merge(&snapshot, thread);
+    snprintf(owner, sizeof(owner), "thread %d", thread->tid);
+    monitor_profile_log(owner, &snapshot, ns_per_tick);
+    monitor_profile_merge(&total, &snapshot);
+  }
+  monitor_profile_log("exited threads", &monitor_profile_exited, ns_per_tick);
+  monitor_profile_merge(&total, &monitor_profile_exited);
+
+  pthread_mutex_unlock(&monitor_profile_lock);
+
+  monitor_profile_log("all threads", &total, ns_per_tick);
+}
+
+/*
+ * Frees the histograms. Every other thread that used a monitor must have
+ * exited.
+ */
+void
+monitor_profile_finalize(void)
+{
+  struct monitor_profile_thread *thread;
+
+  pthread_mutex_lock(&monitor_profile_lock);
+  while ((thread = monitor_profile_threads)) {
+    monitor_profile_threads = thread->next;
+    if (thread == monitor_profile_self) {
+      pthread_setspecific(monitor_profile_key, NULL);
+      monitor_profile_self = NULL;
+    }
+    free(thread);
+  }
+  memset(&monitor_profile_exited, 0, sizeof(struct monitor_profile_thread));
+  pthread_mutex_unlock(&monitor_profile_lock);
+}
+
+#endif /* MONITOR_PROFILE */
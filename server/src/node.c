@@ -1,9 +1,10 @@
 #include "node.h"
 
-#include <bits/pthreadtypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "node_pool.h"
 #include "try.h"
 
 static void node_clear(node_t *self);
@@ -32,14 +33,14 @@ node_new(void)
   node_t *object = NULL;
   node_t *new_object = NULL;
 
-  TRY_ALLOCATE(new_object, node_t);
+  TRY(new_object = node_pool_allocate(), "node allocation failed");
   TRY(node_initialize(new_object), "node initialization failed");
 
   object = new_object;
 
 done:
   if (!object && new_object)
-    free(new_object);
+    node_pool_release(new_object);
 
   return object;
 }
@@ -48,7 +49,7 @@ void
 node_destroy(node_t *self)
 {
   node_finalize(self);
-  free(self);
+  node_pool_release(self);
 }
 
 void
@@ -64,49 +65,7 @@ node_get(const node_t *self)
 }
 
 node_t *
-node_next(const node_t *self)
+node_from_link(list_link_t *link)
 {
-  return self->next;
-}
-
-node_t *
-node_prev(const node_t *self)
-{
-  return self->prev;
-}
-
-void
-node_link_next(node_t *self, node_t *next)
-{
-  self->next = next;
-}
-
-void
-node_link_prev(node_t *self, node_t *prev)
-{
-  self->prev = prev;
-}
-
-void
-node_unlink_next(node_t *self)
-{
-  self->next = NULL;
-}
-
-void
-node_unlink_prev(node_t *self)
-{
-  self->prev = NULL;
-}
-
-bool
-node_has_next(const node_t *self)
-{
-  return self->next != NULL;
-}
-
-bool
-node_has_prev(const node_t *self)
-{
-  return self->prev != NULL;
+  return LIST_ENTRY(link, node_t, link);
 }
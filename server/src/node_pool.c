@@ -0,0 +1,253 @@
+#include "node_pool.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "node.h"
+#include "try.h"
+
+struct node_pool_slab
+{
+  struct node_pool_slab *next;
+  node_t nodes[NODE_POOL_SLAB_NODES];
+};
+
+/* Free nodes are chained through the next pointer of their link. */
+struct node_pool_cache
+{
+  node_t *free_nodes;
+  size_t free_count;
+  /* Counted locally, folded in the shared totals under the lock */
+  size_t allocations;
+  size_t releases;
+  bool registered;
+};
+
+static pthread_mutex_t node_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct node_pool_slab *node_pool_slabs = NULL;
+static node_t *node_pool_free_nodes = NULL;
+static size_t node_pool_free_count = 0;
+static node_pool_stats_t node_pool_totals;
+
+static pthread_once_t node_pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t node_pool_key;
+static __thread struct node_pool_cache node_pool_cache;
+
+static void node_pool_push(node_t **free_nodes, node_t *node);
+static node_t *node_pool_pop(node_t **free_nodes);
+static void node_pool_create_key(void);
+static void node_pool_thread_exit(void *arg);
+static void node_pool_register(struct node_pool_cache *cache);
+static void node_pool_fold_counters(struct node_pool_cache *cache);
+static bool node_pool_grow(void);
+static bool node_pool_refill(struct node_pool_cache *cache);
+static void node_pool_flush(struct node_pool_cache *cache, size_t count);
+
+void
+node_pool_push(node_t **free_nodes, node_t *node)
+{
+  node->link.next = *free_nodes ? &(*free_nodes)->link : NULL;
+  *free_nodes = node;
+}
+
+node_t *
+node_pool_pop(node_t **free_nodes)
+{
+  node_t *node = *free_nodes;
+
+  *free_nodes = node->link.next ? node_from_link(node->link.next) : NULL;
+
+  return node;
+}
+
+void
+node_pool_create_key(void)
+{
+  pthread_key_create(&node_pool_key, node_pool_thread_exit);
+}
+
+/* Gives the cache of an exiting thread back to the other threads. */
+void
+node_pool_thread_exit(void *arg)
+{
+  struct node_pool_cache *cache = arg;
+
+  node_pool_flush(cache, cache->free_count);
+}
+
+/*
+ * Makes node_pool_thread_exit flush the cache of the calling thread when it
+ * exits, whether it allocates nodes or only releases them.
+ */
+void
+node_pool_register(struct node_pool_cache *cache)
+{
+  if (!cache->registered) {
+    pthread_once(&node_pool_key_once, node_pool_create_key);
+    pthread_setspecific(node_pool_key, cache);
+    cache->registered = true;
+  }
+}
+
+/* Must be called with node_pool_lock held. */
+void
+node_pool_fold_counters(struct node_pool_cache *cache)
+{
+  node_pool_totals.allocations += cache->allocations;
+  node_pool_totals.releases += cache->releases;
+  cache->allocations = 0;
+  cache->releases = 0;
+}
+
+/* Must be called with node_pool_lock held. */
+bool
+node_pool_grow(void)
+{
+  bool ok = false;
+  struct node_pool_slab *slab = NULL;
+
+  TRY_ALLOCATE(slab, struct node_pool_slab);
+
+  for (size_t i = 0; i < NODE_POOL_SLAB_NODES; ++i)
+    node_pool_push(&node_pool_free_nodes, &slab->nodes[i]);
+  node_pool_free_count += NODE_POOL_SLAB_NODES;
+
+  slab->next = node_pool_slabs;
+  node_pool_slabs = slab;
+  ++node_pool_totals.slabs;
+
+  ok = true;
+
+done:
+  return ok;
+}
+
+bool
+node_pool_refill(struct node_pool_cache *cache)
+{
+  bool ok = false;
+
+  pthread_mutex_lock(&node_pool_lock);
+
+  if (node_pool_free_count < NODE_POOL_BATCH_NODES)
+    TRY(node_pool_grow(), "node slab allocation failed");
+
+  for (size_t i = 0; i < NODE_POOL_BATCH_NODES; ++i)
+    node_pool_push(&cache->free_nodes, node_pool_pop(&node_pool_free_nodes));
+  node_pool_free_count -= NODE_POOL_BATCH_NODES;
+  cache->free_count += NODE_POOL_BATCH_NODES;
+
+  ++node_pool_totals.refills;
+  node_pool_fold_counters(cache);
+
+  ok = true;
+
+done:
+  pthread_mutex_unlock(&node_pool_lock);
+
+  return ok;
+}
+
+void
+node_pool_flush(struct node_pool_cache *cache, size_t count)
+{
+  assert(count <= cache->free_count);
+
+  pthread_mutex_lock(&node_pool_lock);
+
+  for (size_t i = 0; i < count; ++i)
+    node_pool_push(&node_pool_free_nodes, node_pool_pop(&cache->free_nodes));
+  node_pool_free_count += count;
+  cache->free_count -= count;
+
+  ++node_pool_totals.flushes;
+  node_pool_fold_counters(cache);
+
+  pthread_mutex_unlock(&node_pool_lock);
+}
+
+node_t *
+node_pool_allocate(void)
+{
+  struct node_pool_cache *cache = &node_pool_cache;
+  node_t *node = NULL;
+
+  node_pool_register(cache);
+
+  if (cache->free_nodes || node_pool_refill(cache)) {
+    node = node_pool_pop(&cache->free_nodes);
+    --cache->free_count;
+    ++cache->allocations;
+  }
+
+  return node;
+}
+
+/*
+ * The node goes to the cache of the calling thread, which does not need to be
+ * the one that allocated it.
+ */
+void
+node_pool_release(node_t *node)
+{
+  struct node_pool_cache *cache = &node_pool_cache;
+
+  node_pool_register(cache);
+
+  node_pool_push(&cache->free_nodes, node);
+  ++cache->free_count;
+  ++cache->releases;
+
+  if (cache->free_count >= 2 * NODE_POOL_BATCH_NODES)
+    node_pool_flush(cache, NODE_POOL_BATCH_NODES);
+}
+
+void
+node_pool_flush_thread_cache(void)
+{
+  node_pool_flush(&node_pool_cache, node_pool_cache.free_count);
+}
+
+/*
+ * Includes the counters of the calling thread but not those still local to
+ * other running threads.
+ */
+void
+node_pool_get_stats(node_pool_stats_t *stats)
+{
+  pthread_mutex_lock(&node_pool_lock);
+  node_pool_fold_counters(&node_pool_cache);
+  *stats = node_pool_totals;
+  stats->shared_free_nodes = node_pool_free_count;
+  pthread_mutex_unlock(&node_pool_lock);
+}
+
+/*
+ * Frees every slab. No node may be in use, and every other thread that used
+ * the pool must have exited.
+ */
+void
+node_pool_finalize(void)
+{
+  struct node_pool_slab *slab;
+  bool registered = node_pool_cache.registered;
+
+  pthread_mutex_lock(&node_pool_lock);
+
+  while ((slab = node_pool_slabs)) {
+    node_pool_slabs = slab->next;
+    free(slab);
+  }
+
+  node_pool_free_nodes = NULL;
+  node_pool_free_count = 0;
+  memset(&node_pool_totals, 0, sizeof(node_pool_stats_t));
+  memset(&node_pool_cache, 0, sizeof(struct node_pool_cache));
+  node_pool_cache.registered = registered;
+
+  pthread_mutex_unlock(&node_pool_lock);
+}
@@ -1,45 +1,82 @@
 #include "queue.h"
 
-#include "doubly_linked_list.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#include "try.h"
 
 bool
 queue_initialize(queue_t *self)
 {
-  return doubly_linked_list_initialize(self);
+  tid_ring_init(self);
+  return true;
 }
 
 void
 queue_finalize(queue_t *self)
 {
-  doubly_linked_list_finalize(self);
+  tid_ring_finalize(self);
 }
 
 queue_t *
 queue_new(void)
 {
-  return doubly_linked_list_new();
+  queue_t *new_object = NULL;
+  queue_t *object = NULL;
+
+  TRY_ALLOCATE(new_object, queue_t);
+  TRY(queue_initialize(new_object), "queue initialization failed");
+
+  object = new_object;
+
+done:
+  if (!object && new_object)
+    free(new_object);
+
+  return object;
 }
 
 void
 queue_destroy(queue_t *self)
 {
-  doubly_linked_list_destroy(self);
+  queue_finalize(self);
+  free(self);
+}
+
+size_t
+queue_size(const queue_t *self)
+{
+  return tid_ring_count(self);
 }
 
 bool
 queue_is_empty(queue_t *self)
 {
-  return doubly_linked_list_is_empty(self);
+  return tid_ring_is_empty(self);
+}
+
+/* Position 0 is the next tid to be dequeued. */
+pthread_t
+queue_get(const queue_t *self, size_t pos)
+{
+  assert(pos < queue_size(self));
+
+  return *tid_ring_at(self, pos);
 }
 
 bool
 queue_enqueue(queue_t *self, pthread_t tid)
 {
-  return doubly_linked_list_insert_head(self, tid);
+  return tid_ring_push(self, &tid);
 }
 
 pthread_t
 queue_dequeue(queue_t *self)
 {
-  return doubly_linked_list_remove_tail(self);
+  assert(!queue_is_empty(self));
+
+  pthread_t tid = 0;
+  tid_ring_pop(self, &tid);
+
+  return tid;
 }
@@ -0,0 +1,163 @@
+#include "record_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "try.h"
+
+#define RECORD_INDEX_BATCH 64
+#define RECORD_INDEX_SCAN_SIZE 65536
+
+static bool record_index_write(
+  record_index_t *self,
+  const uint64_t *offsets,
+  size_t count);
+
+bool
+record_index_write(record_index_t *self, const uint64_t *offsets, size_t count)
+{
+  bool ok = false;
+  const char *data = (const char *)offsets;
+  size_t bytes_to_write = count * sizeof(uint64_t);
+  ssize_t bytes_written;
+
+  while (bytes_to_write > 0) {
+    TRYC_RETRY_ON_EINTR(bytes_written = write(self->fd, data, bytes_to_write));
+    data += bytes_written;
+    bytes_to_write -= bytes_written;
+  }
+  self->count += count;
+
+  ok = true;
+
+done:
+  return ok;
+}
+
+/* Truncates filename and indexes what data_fd already holds. */
+bool
+record_index_initialize(record_index_t *self, const char *filename, int data_fd)
+{
+  bool ok = false;
+  char buffer[RECORD_INDEX_SCAN_SIZE];
+  ssize_t bytes_read;
+
+  memset(self, 0, sizeof(record_index_t));
+  self->terminated = true;
+
+  TRYC_ERRNO(
+    self->fd = open(
+      filename,
+      O_RDWR | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+
+  do {
+    TRYC_RETRY_ON_EINTR(
+      bytes_read = pread(data_fd, buffer, sizeof(buffer), self->size));
+    TRY(
+      record_index_append(self, buffer, bytes_read),
+      "record indexing failed");
+  } while (bytes_read > 0);
+
+  ok = true;
+
+done:
+  if (!ok && self->fd != -1) {
+    close(self->fd);
+    self->fd = -1;
+  }
+
+  return ok;
+}
+
+void
+record_index_finalize(record_index_t *self)
+{
+  if (self->fd != -1)
+    close(self->fd);
+  self->fd = -1;
+}
+
+/* Indexes the size bytes of data, just appended to the data file. */
+bool
+record_index_append(record_index_t *self, const char *data, size_t size)
+{
+  bool ok = false;
+  uint64_t offsets[RECORD_INDEX_BATCH];
+  size_t count = 0;
+  const char *position = data;
+  const char *end = data + size;
+  const char *newline;
+
+  while (position < end) {
+    if (self->terminated) {
+      if (count == RECORD_INDEX_BATCH) {
+        TRY(record_index_write(self, offsets, count), "index writing failed");
+        count = 0;
+      }
+      offsets[count++] = self->size + (position - data);
+    }
+
+    newline = memchr(position, '\n', end - position);
+    self->terminated = newline != NULL;
+    if (!newline)
+      break;
+    position = newline + 1;
+  }
+
+  TRY(record_index_write(self, offsets, count), "index writing failed");
+  self->size += size;
+
+  ok = true;
+
+done:
+  return ok;
+}
+
+/*
+ * Stores the position in the data file of offset within record, both from 0.
+ * Fails with errno EINVAL, like AESDCHAR_IOCSEEKTO, if either is out of range.
+ */
+bool
+record_index_find(
+  const record_index_t *self,
+  uint64_t record,
+  uint64_t offset,
+  uint64_t *position)
+{
+  bool ok = false;
+  uint64_t bounds[2] = { 0, self->size };
+  size_t bytes_to_read =
+    (record + 1 < self->count ? 2 : 1) * sizeof(uint64_t);
+  ssize_t bytes_read;
+
+  if (record >= self->count) {
+    errno = EINVAL;
+    goto done;
+  }
+
+  TRYC_RETRY_ON_EINTR(
+    bytes_read =
+      pread(self->fd, bounds, bytes_to_read, record * sizeof(uint64_t)));
+  if ((size_t)bytes_read != bytes_to_read) {
+    errno = EIO;
+    LOG_ERROR("index too short");
+    goto done;
+  }
+
+  if (offset >= bounds[1] - bounds[0]) {
+    errno = EINVAL;
+    goto done;
+  }
+
+  *position = bounds[0] + offset;
+  ok = true;
+
+done:
+  return ok;
+}
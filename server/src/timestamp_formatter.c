@@ -0,0 +1,297 @@
+#include "timestamp_formatter.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "try.h"
+
+#define SECONDS_PER_HOUR 3600
+
+static bool timestamp_formatter_add_field(
+  timestamp_formatter_t *self,
+  size_t *size,
+  timestamp_formatter_field_t field);
+static bool timestamp_formatter_parse(timestamp_formatter_t *self);
+static void timestamp_formatter_patch(
+  timestamp_formatter_t *self,
+  time_t seconds);
+static bool timestamp_formatter_format_hour(
+  timestamp_formatter_t *self,
+  time_t seconds);
+static bool timestamp_formatter_format_second(
+  timestamp_formatter_t *self,
+  time_t seconds);
+
+/* Ends the current piece. */
+bool
+timestamp_formatter_add_field(
+  timestamp_formatter_t *self,
+  size_t *size,
+  timestamp_formatter_field_t field)
+{
+  if (self->field_count == TIMESTAMP_FORMATTER_MAX_FIELDS)
+    return false;
+
+  self->pieces[(*size)++] = '\0';
+  self->fields[self->field_count++] = field;
+
+  return true;
+}
+
+/*
+ * Splits the format in pieces around the fields, spelling out %T and %R.
+ * Returns false if the format has conversions which cannot be patched.
+ */
+bool
+timestamp_formatter_parse(timestamp_formatter_t *self)
+{
+  const char *format = self->format;
+  size_t size = 0;
+  size_t spec_length;
+  char conversion;
+
+  while (*format) {
+    /* Leaves room for "%H:" and the end of the piece */
+    if (size + TIMESTAMP_FORMATTER_SIZE / 2 > sizeof(self->pieces))
+      return false;
+
+    if (*format != '%') {
+      self->pieces[size++] = *format++;
+      continue;
+    }
+
+    spec_length = 1 + strspn(format + 1, "_-0^#");
+    spec_length += strspn(format + spec_length, "0123456789");
+    spec_length += strspn(format + spec_length, "EO");
+    conversion = format[spec_length];
+
+    switch (conversion) {
+      case 'M':
+      case 'S':
+      case 'T':
+      case 'R':
+        if (spec_length > 1)
+          return false;
+        if (conversion == 'T' || conversion == 'R') {
+          memcpy(self->pieces + size, "%H:", 3);
+          size += 3;
+        }
+        if (
+          conversion != 'S' &&
+          !timestamp_formatter_add_field(
+            self,
+            &size,
+            TIMESTAMP_FORMATTER_MINUTES))
+          return false;
+        if (conversion == 'T')
+          self->pieces[size++] = ':';
+        if (
+          (conversion == 'S' || conversion == 'T') &&
+          !timestamp_formatter_add_field(
+            self,
+            &size,
+            TIMESTAMP_FORMATTER_SECONDS))
+          return false;
+        break;
+      case 'c':
+      case 'r':
+      case 's':
+      case 'X':
+      case '+':
+        return false;
+      case '\0':
+        /* strftime copies a trailing incomplete conversion */
+        --spec_length;
+        /* fall through */
+      default:
+        memcpy(self->pieces + size, format, spec_length + 1);
+        size += spec_length + 1;
+    }
+
+    format += spec_length + 1;
+  }
+
+  self->pieces[size] = '\0';
+
+  return true;
+}
+
+void
+timestamp_formatter_patch(timestamp_formatter_t *self, time_t seconds)
+{
+  unsigned offset = seconds - self->hour_start;
+  unsigned value;
+  char *digits;
+
+  for (unsigned i = 0; i < self->field_count; ++i) {
+    value = self->fields[i] == TIMESTAMP_FORMATTER_MINUTES ? offset / 60
+                                                           : offset % 60;
+    digits = self->text + self->field_offsets[i];
+    digits[0] = '0' + value / 10;
+    digits[1] = '0' + value % 10;
+  }
+}
+
+/*
+ * Formats the pieces for the local hour of seconds, leaving two characters
+ * for every field.
+ */
+bool
+timestamp_formatter_format_hour(timestamp_formatter_t *self, time_t seconds)
+{
+  struct tm local;
+  const char *piece = self->pieces;
+  size_t piece_length;
+  size_t length = 0;
+  size_t written;
+
+  if (!localtime_r(&seconds, &local))
+    return false;
+  self->hour_start = seconds - local.tm_min * 60 - local.tm_sec;
+
+  for (unsigned i = 0; i <= self->field_count; ++i) {
+    piece_length = strlen(piece);
+    if (piece_length) {
+      written = strftime(
+        self->text + length,
+        TIMESTAMP_FORMATTER_SIZE - length,
+        piece,
+        &local);
+      if (!written)
+        return false;
+      length += written;
+    }
+
+    if (i < self->field_count) {
+      if (length + 2 >= TIMESTAMP_FORMATTER_SIZE)
+        return false;
+      self->field_offsets[i] = length;
+      length += 2;
+    }
+
+    piece += piece_length + 1;
+  }
+
+  self->text[length] = '\0';
+  self->length = length;
+  timestamp_formatter_patch(self, seconds);
+
+  return true;
+}
+
+bool
+timestamp_formatter_format_second(timestamp_formatter_t *self, time_t seconds)
+{
+  struct tm local;
+
+  if (!localtime_r(&seconds, &local))
+    return false;
+
+  self->length =
+    strftime(self->text, TIMESTAMP_FORMATTER_SIZE, self->format, &local);
+
+  return self->length || !*self->format;
+}
+
+/* Fails on formats longer than TIMESTAMP_FORMATTER_SIZE - 1 characters. */
+bool
+timestamp_formatter_initialize(timestamp_formatter_t *self, const char *format)
+{
+  bool ok = false;
+
+  memset(self, 0, sizeof(timestamp_formatter_t));
+  TRY(
+    strlen(format) < TIMESTAMP_FORMATTER_SIZE,
+    "timestamp format too long");
+  strcpy(self->format, format);
+  self->per_second = !timestamp_formatter_parse(self);
+
+  ok = true;
+
+done:
+  return ok;
+}
+
+void
+timestamp_formatter_finalize(timestamp_formatter_t *self)
+{
+}
+
+timestamp_formatter_t *
+timestamp_formatter_new(const char *format)
+{
+  timestamp_formatter_t *new_object = NULL;
+  timestamp_formatter_t *object = NULL;
+
+  TRY_ALLOCATE(new_object, timestamp_formatter_t);
+  TRY(
+    timestamp_formatter_initialize(new_object, format),
+    "timestamp formatter initialization failed");
+
+  object = new_object;
+
+done:
+  if (!object && new_object)
+    free(new_object);
+
+  return object;
+}
+
+void
+timestamp_formatter_destroy(timestamp_formatter_t *self)
+{
+  timestamp_formatter_finalize(self);
+  free(self);
+}
+
+/*
+ * Returns the text of seconds since the Epoch, valid until the next call, or
+ * NULL if it could not be formatted, for instance if it would be longer than
+ * TIMESTAMP_FORMATTER_SIZE - 1 characters. Stores its length in length unless
+ * it is NULL.
+ */
+const char *
+timestamp_formatter_format(
+  timestamp_formatter_t *self,
+  time_t seconds,
+  size_t *length)
+{
+  bool ok = true;
+
+  if (!self->length || seconds != self->second) {
+    if (self->per_second)
+      ok = timestamp_formatter_format_second(self, seconds);
+    else if (
+      self->length && seconds >= self->hour_start &&
+      seconds - self->hour_start < SECONDS_PER_HOUR)
+      timestamp_formatter_patch(self, seconds);
+    else
+      ok = timestamp_formatter_format_hour(self, seconds);
+
+    if (!ok) {
+      self->length = 0;
+      return NULL;
+    }
+    self->second = seconds;
+  }
+
+  if (length)
+    *length = self->length;
+
+  return self->text;
+}
+
+/* The current time, from the coarse clock which is enough for seconds. */
+const char *
+timestamp_formatter_now(timestamp_formatter_t *self, size_t *length)
+{
+  struct timespec now;
+
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &now) == -1)
+    return NULL;
+
+  return timestamp_formatter_format(self, now.tv_sec, length);
+}
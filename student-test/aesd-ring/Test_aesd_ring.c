@@ -0,0 +1,265 @@
+#include "unity.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../../aesd-char-driver/aesd-ring.h"
+
+AESD_RING_DEFINE(pow2_ring, int, 8)
+AESD_RING_DEFINE(odd_ring, int, 10)
+AESD_RING_DEFINE_SPSC(spsc_ring, size_t, 64)
+AESD_RING_DEFINE_MPSC(mpsc_ring, size_t, 64)
+AESD_RING_DEFINE_MPMC(mpmc_ring, size_t, 64)
+AESD_RING_DEFINE_GROWABLE(growable_ring, int, 4)
+
+#define PRODUCERS 4
+#define CONSUMERS 3
+#define ITEMS_PER_PRODUCER 100000
+
+/**
+* Fills and drains the ring several times so that its positions wrap around,
+* checking FIFO order, the count and the full/empty conditions on the way.
+*/
+#define CHECK_FIXED_RING(name, capacity)                                      \
+    do {                                                                      \
+        struct name ring;                                                     \
+        int value;                                                            \
+        int next_in = 0;                                                      \
+        int next_out = 0;                                                     \
+                                                                              \
+        name##_init(&ring);                                                   \
+        TEST_ASSERT_TRUE(name##_is_empty(&ring));                             \
+        TEST_ASSERT_FALSE(name##_pop(&ring, &value));                         \
+                                                                              \
+        for (int round = 0; round < 5; ++round) {                             \
+            while (name##_push(&ring, &next_in))                              \
+                ++next_in;                                                    \
+            TEST_ASSERT_TRUE(name##_is_full(&ring));                          \
+            TEST_ASSERT_EQUAL_UINT(capacity, name##_count(&ring));            \
+            TEST_ASSERT_EQUAL_INT(next_out, *name##_at(&ring, 0));            \
+            TEST_ASSERT_EQUAL_INT(next_in - 1, *name##_at(&ring, capacity - 1)); \
+            TEST_ASSERT_NULL(name##_at(&ring, capacity));                     \
+                                                                              \
+            for (int i = 0; i < capacity / 2 + round % 2; ++i) {              \
+                TEST_ASSERT_TRUE(name##_pop(&ring, &value));                  \
+                TEST_ASSERT_EQUAL_INT(next_out++, value);                     \
+            }                                                                 \
+            TEST_ASSERT_EQUAL_UINT(next_in - next_out, name##_count(&ring));  \
+        }                                                                     \
+                                                                              \
+        while (name##_pop(&ring, &value))                                     \
+            TEST_ASSERT_EQUAL_INT(next_out++, value);                         \
+        TEST_ASSERT_EQUAL_INT(next_in, next_out);                             \
+        TEST_ASSERT_TRUE(name##_is_empty(&ring));                             \
+    } while (0)
+
+void test_aesd_ring_power_of_two_capacity()
+{
+    CHECK_FIXED_RING(pow2_ring, 8);
+}
+
+void test_aesd_ring_any_capacity()
+{
+    CHECK_FIXED_RING(odd_ring, 10);
+}
+
+void test_aesd_ring_push_overwrite()
+{
+    struct odd_ring ring;
+    int evicted = -1;
+
+    odd_ring_init(&ring);
+    for (int i = 0; i < 10; ++i)
+        TEST_ASSERT_FALSE(odd_ring_push_overwrite(&ring, &i, &evicted));
+
+    for (int i = 10; i < 35; ++i) {
+        TEST_ASSERT_TRUE(odd_ring_push_overwrite(&ring, &i, &evicted));
+        TEST_ASSERT_EQUAL_INT(i - 10, evicted);
+        TEST_ASSERT_EQUAL_INT(i - 9, *odd_ring_at(&ring, 0));
+        TEST_ASSERT_EQUAL_UINT(10, odd_ring_count(&ring));
+    }
+}
+
+void test_aesd_ring_growable()
+{
+    struct growable_ring ring;
+    int value;
+
+    growable_ring_init(&ring);
+    for (int i = 0; i < 3; ++i)
+        TEST_ASSERT_TRUE(growable_ring_push(&ring, &i));
+    TEST_ASSERT_TRUE(growable_ring_pop(&ring, &value));
+
+    /* Grows while the elements wrap around the end of the array */
+    for (int i = 3; i < 1000; ++i)
+        TEST_ASSERT_TRUE(growable_ring_push(&ring, &i));
+    TEST_ASSERT_EQUAL_UINT(999, growable_ring_count(&ring));
+    TEST_ASSERT_EQUAL_UINT(1024, ring.capacity);
+
+    for (int i = 1; i < 1000; ++i) {
+        TEST_ASSERT_EQUAL_INT(i, *growable_ring_at(&ring, 0));
+        TEST_ASSERT_TRUE(growable_ring_pop(&ring, &value));
+        TEST_ASSERT_EQUAL_INT(i, value);
+    }
+    TEST_ASSERT_FALSE(growable_ring_pop(&ring, &value));
+
+    growable_ring_finalize(&ring);
+}
+
+static struct spsc_ring spsc;
+static struct mpsc_ring mpsc;
+static struct mpmc_ring mpmc;
+
+static void *spsc_producer(void *arg)
+{
+    for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        while (!spsc_ring_push(&spsc, &i))
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+void test_aesd_ring_spsc()
+{
+    pthread_t producer;
+    size_t value;
+
+    spsc_ring_init(&spsc);
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&producer, NULL, spsc_producer, NULL));
+
+    for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        while (!spsc_ring_pop(&spsc, &value))
+            sched_yield();
+        TEST_ASSERT_EQUAL_UINT(i, value);
+    }
+
+    pthread_join(producer, NULL);
+    TEST_ASSERT_FALSE(spsc_ring_pop(&spsc, &value));
+}
+
+static void *mpsc_producer(void *arg)
+{
+    size_t producer = (size_t)arg;
+    size_t value;
+
+    for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        value = producer * ITEMS_PER_PRODUCER + i;
+        while (!mpsc_ring_push(&mpsc, &value))
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+/**
+* Every producer pushes an increasing sequence, so the consumer must see each
+* sequence complete and in order whatever the interleaving.
+*/
+void test_aesd_ring_mpsc()
+{
+    pthread_t producers[PRODUCERS];
+    size_t next[PRODUCERS] = {0};
+    size_t value;
+    size_t producer;
+
+    mpsc_ring_init(&mpsc);
+    for (size_t i = 0; i < PRODUCERS; ++i)
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&producers[i], NULL, mpsc_producer, (void *)i));
+
+    for (size_t i = 0; i < PRODUCERS * ITEMS_PER_PRODUCER; ++i) {
+        while (!mpsc_ring_pop(&mpsc, &value))
+            sched_yield();
+        producer = value / ITEMS_PER_PRODUCER;
+        TEST_ASSERT_LESS_THAN_UINT(PRODUCERS, producer);
+        TEST_ASSERT_EQUAL_UINT(next[producer]++, value % ITEMS_PER_PRODUCER);
+    }
+
+    for (size_t i = 0; i < PRODUCERS; ++i)
+        pthread_join(producers[i], NULL);
+    TEST_ASSERT_FALSE(mpsc_ring_pop(&mpsc, &value));
+}
+
+static void *mpmc_producer(void *arg)
+{
+    size_t producer = (size_t)arg;
+    size_t value;
+
+    for (size_t i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        value = producer * ITEMS_PER_PRODUCER + i;
+        while (!mpmc_ring_push(&mpmc, &value))
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+struct mpmc_consumer_result
+{
+    size_t count;
+    size_t sum;
+    bool ordered;
+};
+
+static void *mpmc_consumer(void *arg)
+{
+    struct mpmc_consumer_result *result = arg;
+    size_t next[PRODUCERS] = {0};
+    size_t value;
+    size_t producer;
+
+    result->ordered = true;
+    for (;;) {
+        while (!mpmc_ring_pop(&mpmc, &value))
+            sched_yield();
+        if (value == SIZE_MAX)
+            break;
+
+        producer = value / ITEMS_PER_PRODUCER;
+        result->ordered = result->ordered && producer < PRODUCERS &&
+                          value % ITEMS_PER_PRODUCER >= next[producer];
+        next[producer] = value % ITEMS_PER_PRODUCER + 1;
+        result->sum += value;
+        ++result->count;
+    }
+
+    return NULL;
+}
+
+/**
+* Every value must be consumed exactly once, and each consumer must see the
+* values of a given producer in increasing order.
+*/
+void test_aesd_ring_mpmc()
+{
+    pthread_t producers[PRODUCERS];
+    pthread_t consumers[CONSUMERS];
+    struct mpmc_consumer_result results[CONSUMERS] = {{0}};
+    size_t stop = SIZE_MAX;
+    size_t items = PRODUCERS * ITEMS_PER_PRODUCER;
+    size_t count = 0;
+    size_t sum = 0;
+
+    mpmc_ring_init(&mpmc);
+    for (size_t i = 0; i < CONSUMERS; ++i)
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&consumers[i], NULL, mpmc_consumer, &results[i]));
+    for (size_t i = 0; i < PRODUCERS; ++i)
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&producers[i], NULL, mpmc_producer, (void *)i));
+
+    for (size_t i = 0; i < PRODUCERS; ++i)
+        pthread_join(producers[i], NULL);
+    for (size_t i = 0; i < CONSUMERS; ++i) {
+        while (!mpmc_ring_push(&mpmc, &stop))
+            sched_yield();
+    }
+    for (size_t i = 0; i < CONSUMERS; ++i) {
+        pthread_join(consumers[i], NULL);
+        TEST_ASSERT_TRUE(results[i].ordered);
+        count += results[i].count;
+        sum += results[i].sum;
+    }
+
+    TEST_ASSERT_EQUAL_UINT(items, count);
+    TEST_ASSERT_EQUAL_UINT(items * (items - 1) / 2, sum);
+}
@@ -0,0 +1,102 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../../server/include/timestamp_formatter.h"
+
+/* POSIX rules, so that no time zone database is needed */
+static const char *const time_zones[] = {
+    "UTC0",
+    "CET-1CEST,M3.5.0,M10.5.0/3",
+    /* Lord Howe Island, whose offset changes by half an hour */
+    "LHST-10:30LHDT-11,M10.1.0,M4.1.0",
+    "NST3:30NDT,M3.2.0,M11.1.0",
+};
+
+static const char *const formats[] = {
+    "timestamp:%a, %d %b %Y %T %z",
+    "%H:%M:%S",
+    "%R %p %%M %j %Z",
+    "%S%S%M-",
+    "%c",
+    "%s",
+    "%-M:%OS",
+    "100%",
+    "",
+};
+
+/* 2024-03-31 00:00 UTC, the night CET turns into CEST */
+#define START 1711843200
+/* Past the Lord Howe and Newfoundland transitions of 2024-04-07 and -11-03 */
+#define SPAN (230 * 24 * 3600)
+
+static void check_formatter(const char *format, time_t start, time_t step, int count)
+{
+    timestamp_formatter_t formatter;
+    char expected[TIMESTAMP_FORMATTER_SIZE];
+    char message[512];
+    struct tm local;
+    const char *text;
+    size_t length;
+
+    TEST_ASSERT_TRUE(timestamp_formatter_initialize(&formatter, format));
+
+    for (int i = 0; i < count; ++i) {
+        time_t seconds = start + i * step;
+
+        localtime_r(&seconds, &local);
+        strftime(expected, sizeof(expected), format, &local);
+        text = timestamp_formatter_format(&formatter, seconds, &length);
+
+        snprintf(message, sizeof(message), "format \"%s\" TZ %s at %lld",
+                 format, getenv("TZ"), (long long)seconds);
+        TEST_ASSERT_NOT_NULL_MESSAGE(text, message);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, text, message);
+        TEST_ASSERT_EQUAL_MESSAGE(strlen(expected), length, message);
+    }
+
+    timestamp_formatter_finalize(&formatter);
+}
+
+/**
+* Compares the formatter with strftime over consecutive seconds around the
+* daylight saving time transitions and over months in steps which hit every
+* minute and second, for several time zones and formats.
+*/
+void test_timestamp_formatter_matches_strftime()
+{
+    for (size_t zone = 0; zone < sizeof(time_zones) / sizeof(time_zones[0]); ++zone) {
+        setenv("TZ", time_zones[zone], 1);
+        tzset();
+
+        for (size_t format = 0; format < sizeof(formats) / sizeof(formats[0]); ++format) {
+            check_formatter(formats[format], START - 2 * 3600, 1, 4 * 3600);
+            check_formatter(formats[format], START, 997, SPAN / 997);
+        }
+    }
+
+    unsetenv("TZ");
+    tzset();
+}
+
+void test_timestamp_formatter_caches()
+{
+    timestamp_formatter_t formatter;
+    const char *first;
+    const char *second;
+    char long_format[TIMESTAMP_FORMATTER_SIZE + 1];
+
+    TEST_ASSERT_TRUE(timestamp_formatter_initialize(&formatter, "%T"));
+    TEST_ASSERT_NOT_NULL(first = timestamp_formatter_now(&formatter, NULL));
+    TEST_ASSERT_NOT_NULL(second = timestamp_formatter_now(&formatter, NULL));
+    TEST_ASSERT_EQUAL_PTR(first, second);
+    timestamp_formatter_finalize(&formatter);
+
+    memset(long_format, 'x', TIMESTAMP_FORMATTER_SIZE);
+    long_format[TIMESTAMP_FORMATTER_SIZE] = '\0';
+    TEST_ASSERT_FALSE_MESSAGE(
+        timestamp_formatter_initialize(&formatter, long_format),
+        "Formats which do not fit must be refused");
+}
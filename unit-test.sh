@@ -11,3 +11,10 @@ make clean
 make
 cd ..
 ./build/assignment-autotest/assignment-autotest
+rc=$?
+
+# PERF_GATE=1 also fails on performance regressions, see perf-test.sh
+if [ "${PERF_GATE}" == "1" ]; then
+    ./perf-test.sh || rc=1
+fi
+exit ${rc}